@@ -1,6 +1,6 @@
 /*****************************************************************************
  *
- * Copyright (c) 2015-2019 jnsbyr
+ * Copyright (c) 2015-2026 jnsbyr
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -32,8 +32,17 @@
 void ICACHE_FLASH_ATTR adcDriverInit();
 void ICACHE_FLASH_ATTR adcDriverShutdown();
 
-#if VALVE_DRIVER_TYPE == 1
+#define ADC_MAX_SAMPLES 32
+
+enum AdcFilter {ADC_FILTER_MEAN         = 0,  // average of all samples
+                ADC_FILTER_MEDIAN       = 1,  // median of all samples
+                ADC_FILTER_TRIMMED_MEAN = 2}; // average without lowest and highest quarter of samples
+
+#if ADC_SAMPLES < 1 || ADC_SETTLE_SAMPLES + ADC_SAMPLES > ADC_MAX_SAMPLES
+#error "ADC_SAMPLES plus ADC_SETTLE_SAMPLES must be 1 .. ADC_MAX_SAMPLES"
+#endif
+
+uint16 ICACHE_FLASH_ATTR adcGetMaxReadTime();
 uint16 adcRead();
-#endif /* VALVE_DRIVER_TYPE == 1 */
 
 #endif /* __USER_ADC_H__ */
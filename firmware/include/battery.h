@@ -0,0 +1,42 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    battery.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_BATTERY_H__
+#define __USER_BATTERY_H__
+
+#include "main.h"
+
+#define BATTERY_SAMPLE_INTERVAL 43200 // [s] 12 h, interval of battery voltage history
+#define BATTERY_MIN_TREND           3 // minimum number of voltage history samples required to fit voltage trend
+
+void   ICACHE_FLASH_ATTR batteryReset(SleeperStateT* sleeperState);
+void   ICACHE_FLASH_ATTR batteryAddSleep(SleeperStateT* sleeperState, uint32 slept);
+void   ICACHE_FLASH_ATTR batteryAddWake(SleeperStateT* sleeperState, uint32 uptime);
+uint32 ICACHE_FLASH_ATTR batteryStartWake(SleeperStateT* sleeperState);
+sint16 ICACHE_FLASH_ATTR batteryGetDays(SleeperStateT* sleeperState);
+uint32 ICACHE_FLASH_ATTR batteryGetDowntime(SleeperStateT* sleeperState);
+
+#endif /* __USER_BATTERY_H__ */
@@ -0,0 +1,50 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    circuit.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_CIRCUIT_H__
+#define __USER_CIRCUIT_H__
+
+#include "main.h"
+
+#if CIRCUIT_SIMULATION
+
+typedef struct
+{
+  uint16 resistance;       // [ohm] valve coil including connector, 0 = broken connector
+  uint16 capacitance;      // [uF]
+  uint16 supplyVoltage;    // [mV] generator open circuit voltage
+  uint16 sourceResistance; // [ohm] generator internal resistance, supply sag under load
+  uint16 latchTime;        // [ms] plunger movement after start of open pulse
+} CircuitConfigT;
+
+void ICACHE_FLASH_ATTR circuitInit();
+void ICACHE_FLASH_ATTR circuitConfigure(const CircuitConfigT* config);
+void ICACHE_FLASH_ATTR circuitSample(uint16* buffer, uint8 count);
+void ICACHE_FLASH_ATTR circuitReport();
+
+#endif /* CIRCUIT_SIMULATION */
+
+#endif /* __USER_CIRCUIT_H__ */
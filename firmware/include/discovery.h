@@ -0,0 +1,39 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    discovery.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_DISCOVERY_H__
+#define __USER_DISCOVERY_H__
+
+#include "main.h"
+
+#define DISCOVERY_FLASH_SECTOR 1 // user data sector index, @see getUserDataSector()
+
+void  ICACHE_FLASH_ATTR discoveryLoad(SleeperStateT* sleeperState);
+uint8 ICACHE_FLASH_ATTR discoveryStart(SleeperStateT* sleeperState, const char* version);
+uint8 ICACHE_FLASH_ATTR discoveryCheck(SleeperStateT* sleeperState);
+void  ICACHE_FLASH_ATTR discoveryUplinkResult(SleeperStateT* sleeperState, uint8 replied);
+
+#endif /* __USER_DISCOVERY_H__ */
@@ -0,0 +1,43 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    drift.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_DRIFT_H__
+#define __USER_DRIFT_H__
+
+#include "main.h"
+
+#define DRIFT_MIN_SLEEP  3600000 // [ms] 1 h, minimum sleep duration covered by a drift sample
+#define DRIFT_MIN_FIT          3 // minimum number of drift samples required to fit downtime scale
+
+void   ICACHE_FLASH_ATTR driftReset(SleeperStateT* sleeperState);
+void   ICACHE_FLASH_ATTR driftAddSleep(SleeperStateT* sleeperState, uint32 slept);
+void   ICACHE_FLASH_ATTR driftAddMeasuredSleep(SleeperStateT* sleeperState, uint32 slept, sint32 error);
+void   ICACHE_FLASH_ATTR driftInvalidate(SleeperStateT* sleeperState);
+void   ICACHE_FLASH_ATTR driftObserve(SleeperStateT* sleeperState, sint32 error);
+void   ICACHE_FLASH_ATTR driftSynchronized(SleeperStateT* sleeperState, sint32 error);
+sint16 ICACHE_FLASH_ATTR driftGetDeviation(SleeperStateT* sleeperState);
+
+#endif /* __USER_DRIFT_H__ */
@@ -1,6 +1,6 @@
 /*****************************************************************************
  *
- * Copyright (c) 2015-2016 jnsbyr
+ * Copyright (c) 2015-2026 jnsbyr
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -53,6 +53,23 @@ struct ets_tm
   uint32 tm_isdst; /* +1 DST, 0 no DST, -1 unknown */
 };
 
+/*
+ * rule based time zone description (subset of POSIX TZ, e.g. "CET-1CEST,M3.5.0,M10.5.0/3")
+ */
+struct ets_tz            // 14 Byte
+{
+  sint16 offset;         /* minutes east of UTC for standard time */
+  sint16 dstOffset;      /* minutes added to offset while DST is active, 0 = no DST */
+  uint16 dstStartTime;   /* DST start: minutes since midnight, local standard time */
+  uint16 dstEndTime;     /* DST end: minutes since midnight, local DST time */
+  uint8  dstStartMonth;  /* DST start: month 1-12 */
+  uint8  dstStartWeek;   /* DST start: week of month 1-5 (5 = last) */
+  uint8  dstStartWday;   /* DST start: days since Sunday (0-6) */
+  uint8  dstEndMonth;    /* DST end: month 1-12 */
+  uint8  dstEndWeek;     /* DST end: week of month 1-5 (5 = last) */
+  uint8  dstEndWday;     /* DST end: days since Sunday (0-6) */
+};
+
 /**
  * convert struct ets_tm to milliseconds since 1970 (tm_isdst, tm_wday and tm_yday will be ignored)
  */
@@ -63,6 +80,26 @@ uint64 ICACHE_FLASH_ATTR esp_mktime(struct ets_tm* tms);
  */
 void ICACHE_FLASH_ATTR esp_gmtime(uint64* t, struct ets_tm* tms);
 
+/**
+ * convert milliseconds since 1970 to struct ets_tm in local time of time zone tz (tm_isdst is set)
+ */
+void ICACHE_FLASH_ATTR esp_localtime(uint64* t, const struct ets_tz* tz, struct ets_tm* tms);
+
+/**
+ * convert struct ets_tm in local time of time zone tz to milliseconds since 1970 (tm_isdst, tm_wday and tm_yday will be ignored)
+ */
+uint64 ICACHE_FLASH_ATTR esp_mklocaltime(struct ets_tm* tms, const struct ets_tz* tz);
+
+/**
+ * get offset of local time to UTC in minutes for milliseconds since 1970
+ */
+sint32 ICACHE_FLASH_ATTR esp_tzoffset(uint64* t, const struct ets_tz* tz);
+
+/**
+ * convert POSIX TZ string with format std offset [dst [offset],Mm.w.d[/time],Mm.w.d[/time]] into struct ets_tz
+ */
+const char* ICACHE_FLASH_ATTR esp_tzset(const char *s, struct ets_tz* tz);
+
 /**
  * convert string with fixed format [YYYY-MM-DDT]HH:MI[:SS[[.FFF]Z]] into struct tm (tm_yday and tm_isdst will not be set)
  */
@@ -0,0 +1,39 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    fixmath.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+
+#ifndef __USER_FIXMATH_H__
+#define __USER_FIXMATH_H__
+
+#include <c_types.h>
+
+#define FIX_ONE 65536UL // 1.0 in Q16.16
+
+uint32 ICACHE_FLASH_ATTR fixLog2(uint32 x);
+uint32 ICACHE_FLASH_ATTR fixLnRatio(uint32 num, uint32 den);
+uint32 ICACHE_FLASH_ATTR fixExpNeg(uint32 x);
+
+#endif /* __USER_FIXMATH_H__ */
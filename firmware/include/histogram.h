@@ -0,0 +1,39 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    histogram.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_HISTOGRAM_H__
+#define __USER_HISTOGRAM_H__
+
+#include "main.h"
+
+#define HISTOGRAM_MIN_SAMPLES 16 // minimum number of samples required for percentile
+
+void   ICACHE_FLASH_ATTR histogramReset(HistogramT* histogram);
+void   ICACHE_FLASH_ATTR histogramAdd(HistogramT* histogram, uint16 unit, uint32 value);
+uint32 ICACHE_FLASH_ATTR histogramPercentile(const HistogramT* histogram, uint16 unit, uint8 percentile);
+uint16 ICACHE_FLASH_ATTR histogramFormat(const HistogramT* histogram, char* buffer);
+
+#endif /* __USER_HISTOGRAM_H__ */
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    log.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_LOG_H__
+#define __USER_LOG_H__
+
+#include <c_types.h>
+
+#include "user_config.h"
+
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO    3
+#define LOG_LEVEL_DEBUG   4
+
+#define LOG_RING_SIZE    32 // entries of binary log ring
+#define LOG_MAX_ARGS      4 // argument words per entry of binary log ring
+
+// log output of enabled levels
+#if LOG_RING
+#define LOG_OUTPUT(...) logRecord(__VA_ARGS__)
+#else
+#define LOG_OUTPUT(...) ets_uart_printf(__VA_ARGS__)
+#endif
+
+// disabled levels are type checked but removed with their format strings by the optimizer
+#define LOG_DISCARD(...) do { if (0) ets_uart_printf(__VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_OUTPUT(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) LOG_OUTPUT(__VA_ARGS__)
+#else
+#define LOG_WARNING(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_OUTPUT(__VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_OUTPUT(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if LOG_RING
+void   ICACHE_FLASH_ATTR logRecord(const char* format, ...);
+uint16 ICACHE_FLASH_ATTR logFormat(char* buffer, uint16 size);
+#endif
+
+// @see ld/eagle.rom.addr.v6.ld
+extern int ets_uart_printf(const char *format, ...);
+
+#endif /* __USER_LOG_H__ */
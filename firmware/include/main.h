@@ -31,21 +31,49 @@
 #include <ip_addr.h>
 
 #include "user_config.h"
+#include "esp_time.h"
+#include "log.h"
 
 #define SLEEPER_BOOTTIME            87 // [ms] bootloader runtime after reset
 #define SLEEPER_COMMANDTIME        600 // [ms] 0.6 s, typical time runtime (boot, AP connect and TCP handshake)
 #define SLEEPER_MIN_DOWNTIME      1000 // [ms] 1.0 s, minimum time between shutdown and restart
+#define SLEEPER_LEADTIME           100 // [ms] default time to wakeup before next event if no latency samples are available
+#define DEFAULT_LEAD_PERCENTILE     90 // [%] percentile of wakeup to valve control latency to use as wakeup lead time, events fire late only when latency exceeds it
 
 #define DEFAULT_DEEP_SLEEP_SCALE 10375 // extend deep sleep duration by 3.75% to compensate for early wakeup by RTC
+#define MIN_DEEP_SLEEP_SCALE      9000 // -10%
+#define MAX_DEEP_SLEEP_SCALE     11000 // +10%
 
 #define MIN_BATTERY_VOLTAGE       3270 // [mV] minimum supply voltage before shutting down operation (nominal regulated voltage is 3320 mV)
+#define DEFAULT_STRETCH_DAYS        30 // [d] predicted battery runtime below which downtime is stretched
+#define DEFAULT_MAX_STRETCH        400 // [%] downtime stretch factor when battery is empty
+#define MAX_STRETCHED_DOWNTIME 10800000 // [ms] 3 h, max. deep sleep duration of SDK is about 3.5 h
+#define DEFAULT_WAKE_BUDGET       450 // [mAs] max. charge per wake cycle (6 s awake)
+#define DEFAULT_DAY_BUDGET      14400 // [mAs] max. awake charge per day (4 mAh)
+#define MIN_AWAKE_BUDGET         1500 // [ms] min. awake time of wake cycle when energy budget is used up
 
 #define MAX_WLAN_TIME             8000 // [ms] timeout
 #define MAX_UPLINK_TIME           2000 // [ms] timeout
+#define MAX_DISCOVERY_TIME         500 // [ms] timeout
+#define MAX_ISLAND_BACKOFF           4 // max. exponent of uplink backoff, 2^n - 1 wake cycles with RF disabled between uplink attempts
+#define MIN_WLAN_TIME             1000 // [ms] min. learned timeout
+#define MIN_UPLINK_TIME            400 // [ms] min. learned timeout
+#define TIMEOUT_PERCENTILE          95 // [%] percentile of observed latency used as learned timeout
+#define WLAN_HISTOGRAM_UNIT         64 // [ms] upper bound of first bucket of WLAN association time histogram
+#define UPLINK_HISTOGRAM_UNIT       16 // [ms] upper bound of first bucket of TCP request to reply time histogram
+#define CONNECT_HISTOGRAM_UNIT       8 // [ms] upper bound of first bucket of TCP connect time histogram
+#define REPLY_HISTOGRAM_UNIT         8 // [ms] upper bound of first bucket of server reply time histogram
+#define PARSE_HISTOGRAM_UNIT         4 // [ms] upper bound of first bucket of reply parsing time histogram
+#define DEFAULT_TIMING_INTERVAL     24 // [h] upload interval of timing histograms
 #define WLAN_TIMER_PERIOD          500 // [ms] interval
 #define UPLINK_TIMER_PERIOD        200 // [ms] interval
+#define VALVE_POLL_PERIOD           10 // [ms] interval
 
-#define MAX_ACTIVITIES 32
+#define MAX_ACTIVITIES (32 - 6*(MAX_VALVES - 1)) // each additional valve takes the RTC memory of 6 activities
+#define DRIFT_SAMPLES   6
+#define LATENCY_SAMPLES 8
+#define BATTERY_SAMPLES 6
+#define HISTOGRAM_BUCKETS 8
 
 
 enum SleeperMode {MODE_OFF    = 0,
@@ -58,23 +86,66 @@ enum ValveStatus {VALVE_STATUS_UNKNOWN           = 0,
                   VALVE_STATUS_LOW_OPEN_VOLTAGE  = 3,
                   VALVE_STATUS_LOW_CLOSE_VOLTAGE = 4};
 
+enum ValveDriverType {VALVE_DRIVER_CAPACITOR = 1,
+                      VALVE_DRIVER_HBRIDGE   = 2,
+                      VALVE_DRIVER_SIMULATED = 3};
+
 enum ActivityDay {DAY_INVALID = 0,
                   DAY_EVERY   = 1,
                   DAY_SECOND  = 2,
                   DAY_THIRD   = 3,
                   DAY_SUNDAY  = 4};
 
+enum TimingHistogram {TIMING_ASSOCIATION = 0, // WLAN association until IP is up
+                      TIMING_CONNECT     = 1, // TCP connect
+                      TIMING_REPLY       = 2, // TCP request sent until reply received
+                      TIMING_PARSE       = 3, // reply parsing
+                      TIMING_HISTOGRAMS  = 4};
+
 
-typedef struct          // 5 Byte
+typedef struct          // 6 Byte
 {
   uint8 day;            // 0 = invalid, 1 = every, 2 = Sunday, 3 = Monday, ...
+  uint8 valve;          // valve index
   uint16 startTime;     // minutes since midnight
   uint16 duration;      // seconds
 } ActivityT;
 
-#define SLEEPER_STATE_MAGIC 0xB5B0
+typedef struct          // 4 Byte
+{
+  uint16 slept;         // seconds, requested sleep duration covered by sample (saturated)
+  uint16 scale;         // downtime scale that would have compensated the observed error (10000 = 1.0)
+} DriftSampleT;
+
+typedef struct          // H Byte
+{
+  uint8 count[HISTOGRAM_BUCKETS]; // number of samples per bucket, bucket i < unit*2^i, last bucket unbounded
+} HistogramT;
+
+typedef struct          // 6 Byte
+{
+  uint16 openPulse;     // 100 microseconds
+  uint16 closePulse;    // 100 microseconds
+  uint8  settleTime;    // 100 microseconds, generator voltage settle time before pulse
+  uint8  shortTime;     // 100 microseconds, valve short circuit time after pulse
+} PulseProfileT;
 
-typedef struct                          // 96 + N*5 Byte
+typedef struct               // 32 Byte
+{
+  uint8  open;               // bool, valve state
+  uint8  closeTimeEstimated; // bool, valve close time is only estimated
+  uint8  status;             // status of last valve operation
+  uint8  reserved;
+  uint16 resistance;         // ohm, valve resistance, detected while opening
+  uint16 openCount;          // total number valve was opened since init
+  uint32 openDuration;       // seconds, total duration the valve was open since init
+  uint64 openTime;           // milliseconds, time when valve was opened
+  uint64 closeTime;          // milliseconds, time when valve must be closed
+} ValveStateT;
+
+#define SLEEPER_STATE_MAGIC 0xB5C1
+
+typedef struct                          // 164 + V*32 + N*6 + M*4 + L*2 + K*2 + 6*H Byte
 {
   uint16 magic;                         // static
 
@@ -83,50 +154,98 @@ typedef struct                          // 96 + N*5 Byte
   uint8  overriddenMode;                // state, mode to set when override ends
   uint8  override;                      // state, bool, manual override of current activity
   uint8  overrideEndTimeEstimated;      // state, bool, override end time is only estimated
-  uint8  valveOpen;                     // state, bool, valve state
-  uint8  valveCloseTimeEstimated;       // state, bool, valve close time is only estimated
   uint8  lowBattery;                    // state, bool, vdd33 voltage is below hard coded limit
   uint8  lowBatteryTimeEstimated;       // state, bool, low bat reporting time is only estimated
-  uint8  lastValveOperationStatus;      // state, status of last valve operation
+  uint8  autoTimeScale;                 // config, bool, fit downtime scale from sync history
+  uint8  driftBaseline;                 // state, bool, driftError and driftSlept are valid
+  uint8  driftSampleCount;              // state, number of valid drift samples
+  uint8  driftSampleNext;               // state, index of next drift sample
+  uint8  driftMeasured;                 // state, bool, current drift sample is based on RTC counter
+  uint8  leadPercentile;                // config, percentile of wakeup latency used as wakeup lead time
+  uint8  latencySampleCount;            // state, number of valid wakeup latency samples
+  uint8  latencySampleNext;             // state, index of next wakeup latency sample
+  uint8  tracePending;                  // state, bool, valve curves in flash not yet uploaded
+  uint8  openPulseMargin;               // config, milliseconds, open pulse safety margin after latching, 0 = full pulse
+  uint8  openLatchTime;                 // state, milliseconds, learned time until valve latches, 0 = unknown
+  uint8  lastOpenPulseTime;             // state, milliseconds, duration of last open pulse
+  uint8  batterySampleCount;            // state, number of valid battery voltage samples
+  uint8  batterySampleNext;             // state, index of next battery voltage sample
+  uint8  stretchDays;                   // config, days, predicted battery runtime below which downtime is stretched, 0 = disabled
+  uint8  budgetCuts;                    // state, number of uplinks abandoned on current day because energy budget was used up
+  uint8  budgetDay;                     // state, days since epoch (UTC) modulo 256 of dayCharge and budgetCuts
+  uint8  serverFailures;                // state, consecutive uplinks without reply from server while WLAN was connected
+  uint8  uplinkFailures;                // state, consecutive wake cycles with failed uplink
+  uint8  islandWakes;                   // state, remaining wake cycles with RF disabled (island mode)
+  uint8  timingInterval;                // config, hours, upload interval of timing histograms, 0 = disabled
 
   uint16 valveSupplyVoltage;            // state, volt, valve driver supply voltage, max. detected since init
-  uint16 totalOpenCount;                // state, total number valve was opened since init
-  uint16 valveResistance;               // state, ohm, valve resistance, detected while opening
   uint16 maxValveResistance;            // config, ohm, max. valve resistance
+  uint16 valveCapacitance;              // state, microfarad, effective capacitance fitted from discharge curve, 0 = unknown
   uint16 boottime;                      // config, milliseconds
   uint16 defaultDuration;               // config, seconds, default duration to keep vale open (manual mode, override)
   uint16 downtimeScale;                 // config, 10000 = 1.0
   sint16 batteryOffset;                 // config, millivolt
+  uint16 batteryLevel;                  // state, millivolt Q3, smoothed battery voltage, 0 = unknown
+  uint16 wakeCharge;                    // state, milliampere seconds, smoothed charge per wake cycle, 0 = unknown
+  uint16 maxStretch;                    // config, percent, downtime stretch factor when battery is empty
+  uint16 wakeBudget;                    // config, milliampere seconds, max. charge per wake cycle, 0 = unlimited
+  uint16 dayBudget;                     // config, milliampere seconds, max. awake charge per day, 0 = unlimited
+  uint16 dayCharge;                     // state, milliampere seconds, awake charge on current day
+  uint16 serverPort;                    // state, TCP port of server
 
   uint32 activityProgramId;             // config
   uint32 downtime;                      // config, milliseconds
   uint32 lastDowntime;                  // state, milliseconds, last sleep duration
-  uint32 totalOpenDuration;             // state, seconds, total duration the valve was open since init
+  sint32 driftError;                    // state, milliseconds, clock error observed at start of current drift sample
+  uint32 driftSlept;                    // state, milliseconds, requested sleep duration since start of current drift sample
+  uint32 shutdownRtcTime;               // state, RTC clock periods, RTC counter at lastShutdownTime
+  uint32 shutdownRtcCali;               // state, microseconds Q12, RTC clock period at lastShutdownTime, 0 = unknown
+  uint32 batteryConsumed;               // state, milliampere seconds, estimated charge drawn since cold boot
+  uint32 batteryElapsed;                // state, seconds, sleep duration since last battery voltage sample
+  uint32 serverIp;                      // state, IPv4 address of server, 0 = unknown (discover)
+  uint32 timingElapsed;                 // state, seconds, time since start of timing histograms
 
-  uint64 valveOpenTime;                 // state, milliseconds, time when valve was opened
-  uint64 valveCloseTime;                // state, milliseconds, time when valve must be closed
   uint64 lastShutdownTime;              // state, milliseconds, time when last os shutdown was initiated
   uint64 overrideEndTime;               // state, milliseconds, time when override is reset
   uint64 lowBatteryTime;                // state, milliseconds, time until permanent deep sleep to report low bat
 
   struct ip_info ipConfig;              // state
 
+  struct ets_tz timeZone;               // config, local time zone for activity schedule
+  PulseProfileT pulseProfile;           // config, H-bridge and simulated driver pulse timing
+
+  ValveStateT valves[MAX_VALVES];       // state, valve 0 is operated by user wakeup and manual mode
+  DriftSampleT driftSamples[DRIFT_SAMPLES]; // state, deep sleep drift history
+  uint16 latencySamples[LATENCY_SAMPLES]; // state, milliseconds, wakeup to valve control latency history
+  uint16 batterySamples[BATTERY_SAMPLES]; // state, millivolt, smoothed battery voltage history
+  HistogramT wlanHistogram;             // state, milliseconds, WLAN association time with cached IP address
+  HistogramT uplinkHistogram;           // state, milliseconds, TCP request to reply time
+  HistogramT timingHistograms[TIMING_HISTOGRAMS]; // state, milliseconds, timing since timingElapsed was reset, @see enum TimingHistogram
+
   ActivityT activities[MAX_ACTIVITIES]; // config
 } PersistentStateT;
 
+// compile time check of RTC user memory size (max. 512 bytes)
+typedef char PersistentStateSizeCheckT[sizeof(PersistentStateT) <= 512? 1 : -1];
+
 typedef struct
 {
   PersistentStateT rtcMem; // persistent values
   uint64 now;              // last sampled real time [ms]
+  uint32 measuredDowntime; // time between last shutdown and boot measured with RTC counter [ms], 0 = unknown
   sint16 batteryVoltage;   // supply voltage at time of boot
+  uint16 roundTripTime;    // TCP request to reply round trip time without server processing time [ms]
   sint8  rssi;             // RSSI at time of connect
   uint8  timeSynchronized; // bool, current time is synchronized with server
+  uint8  latencyValid;     // bool, wakeup was scheduled (no cold boot, no user wakeup)
 } SleeperStateT;
 
 uint64 getTime();
+#if SCENARIO_BENCHMARK
+void setTime(uint64 now);
+#endif
+uint32 getUserDataSector(uint8 index);
+uint8 scheduleDowntime(uint64 eventTime);
 void comProcessing();
 
-// @see ld/eagle.rom.addr.v6.ld
-extern int ets_uart_printf(const char *format, ...);
-
 #endif /* __USER_MAIN_H__ */
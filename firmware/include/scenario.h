@@ -0,0 +1,50 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    scenario.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_SCENARIO_H__
+#define __USER_SCENARIO_H__
+
+#include "main.h"
+
+#if SCENARIO_BENCHMARK
+
+#if VALVE_DRIVER_TYPE != 3
+#error "SCENARIO_BENCHMARK requires the simulated valve driver as default driver (VALVE_DRIVER_TYPE 3)"
+#endif
+
+#define SCENARIO_DAYS             30 // simulated days
+#define SCENARIO_DOWNTIME     900000 // [ms] 15 min, regular downtime
+#define SCENARIO_PROCESS_TIME     50 // [ms] awake time without WLAN and valve operation
+#define SCENARIO_CONNECT_TIME    600 // [ms] typical AP association and TCP connect time
+#define SCENARIO_CONNECT_JITTER  400 // [ms] max. additional random connect time
+#define SCENARIO_REPLY_TIME      100 // [ms] server reply latency
+#define SCENARIO_LOSS_RATE         5 // [%] wake cycles without server reply
+
+void ICACHE_FLASH_ATTR scenarioRun(SleeperStateT* sleeperState);
+
+#endif /* SCENARIO_BENCHMARK */
+
+#endif /* __USER_SCENARIO_H__ */
@@ -0,0 +1,64 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    trace.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+
+#ifndef __USER_TRACE_H__
+#define __USER_TRACE_H__
+
+#include "main.h"
+
+#define TRACE_POINTS          16 // max. number of points per curve
+#define TRACE_MIN_DELTA      100 // [mV] min. distance of point from asymptote to be used for RC fit
+#define TRACE_FLASH_SECTOR     0 // user data sector index, @see getUserDataSector()
+
+enum TraceCurve {TRACE_DISCHARGE = 0,  // capacitor discharge via valve and resistor before opening
+                 TRACE_OPEN      = 1,  // capacitor charge via valve while opening
+                 TRACE_CLOSE     = 2,  // capacitor discharge via valve while closing
+                 TRACE_CURVES    = 3};
+
+typedef struct          // 4 Byte
+{
+  uint16 time;          // 32 microseconds, since start of curve
+  uint16 voltage;       // millivolt
+} TracePointT;
+
+typedef struct          // 8 + P*4 Byte
+{
+  uint8  count;         // number of valid points
+  uint8  reserved;
+  uint16 asymptote;     // millivolt, final voltage of RC model
+  uint32 tau;           // microseconds, fitted time constant, 0 = unknown
+  TracePointT points[TRACE_POINTS];
+} TraceCurveT;
+
+void   ICACHE_FLASH_ATTR traceStart(uint8 curve, uint32 duration, uint16 voltage);
+void   ICACHE_FLASH_ATTR traceSample(uint32 elapsed, uint16 voltage);
+uint32 ICACHE_FLASH_ATTR traceFinish(uint16 asymptote);
+void   ICACHE_FLASH_ATTR traceSave(SleeperStateT* sleeperState);
+uint16 ICACHE_FLASH_ATTR traceFormat(SleeperStateT* sleeperState, char* buffer, uint16 size);
+void   ICACHE_FLASH_ATTR traceUploaded(SleeperStateT* sleeperState);
+
+#endif /* __USER_TRACE_H__ */
@@ -29,10 +29,12 @@
 
 #include <c_types.h>
 
-void ICACHE_FLASH_ATTR uplink_sendRequest(char* remoteIP, uint16 remotePort, char* message);
+void ICACHE_FLASH_ATTR uplink_sendRequest(uint32 remoteIP, uint16 remotePort, char* message);
 uint8 ICACHE_FLASH_ATTR uplink_hasReceived();
 char* ICACHE_FLASH_ATTR uplink_getReply();
 uint16 ICACHE_FLASH_ATTR uplink_getReplySize();
+uint32 ICACHE_FLASH_ATTR uplink_getRequestTime();
+uint32 ICACHE_FLASH_ATTR uplink_getReplyTime();
 
 void ICACHE_FLASH_ATTR uplink_sendMessage(char* message);
 uint8 ICACHE_FLASH_ATTR uplink_isSend();
@@ -33,20 +33,37 @@
 #define REMOTE_IP   "192.168.0.1"           // IP address of control server
 #define REMOTE_PORT 3030                    // port of control server
 
+#define DISCOVERY_PORT 3030                 // UDP port of control server discovery broadcast, REMOTE_IP and REMOTE_PORT are used if no server replies
+#define DISCOVERY_FAILURES 3                // consecutive uplinks without reply from server before server is discovered again
+#define DISCOVERY_TOKEN "SLEEPER-TOKEN"     // shared secret of server discovery, server reply is ignored if it does not match (max. 31 chars)
+
 #define DEFAULT_DOWNTIME           10000    // [ms] - default 10 s initial deep sleep duration while not configured
 #define DEFAULT_MANUAL_DURATION      600    // [s] - default 10 min manual override valve open duration while not configured
 #define MAX_VALVE_OPEN_DOWNTIME   300000    // [ms] - default 5 min maximum downtime while valve is open
 
 #define LOW_BATTERY_REPORTING_DURATION (24LU*60*60*1000) // 24 h -> [ms] - max. delay before entering permanent deep sleep after detecting low batter condition
 
-#define VALVE_DRIVER_TYPE              1    // 1=capacitor, 2=H-bridge
+#define BATTERY_CAPACITY            2600    // [mAh] - 18650 lithium-ion cell
+#define AWAKE_CURRENT                 75    // [mA] - typical average current while awake (WLAN station)
+#define SLEEP_CURRENT                 60    // [uA] - typical current of circuit in deep sleep including self discharge
+
+#define VALVE_DRIVER_TYPE              1    // 1=capacitor, 2=H-bridge, 3=simulated (no valve hardware), must match board
+#define MAX_VALVES                     1    // 1..4 valves, multiple valves are selected by GPIO 0 and GPIO 2 (binary coded), each additional valve reduces MAX_ACTIVITIES by 6
+#define SCENARIO_BENCHMARK             0    // 1 = benchmark wake cycles of 30 days on virtual clock at cold boot (requires VALVE_DRIVER_TYPE 3)
 
-#if (VALVE_DRIVER_TYPE == 1)
+#define LOG_LEVEL                      4    // 0=none, 1=error, 2=warning, 3=info, 4=debug (incl. JSON payloads), messages above level are removed from build
+#define LOG_RING                       0    // 1 = store log messages as format ID and arguments in RAM instead of UART output, sent with status message on request
+
+// capacitor valve driver (type 1)
 
 #define ADC_DIVIDER_RATIO             11    // ADC input voltage divider ratio
+#define ADC_SAMPLES                   10    // ADC samples per reading
+#define ADC_SETTLE_SAMPLES            10    // max. ADC samples to discard after enabling measurement at capacitor
+#define ADC_SETTLE_TOLERANCE           2    // [LSB] max. difference between consecutive ADC samples of settled input
+#define ADC_FILTER       ADC_FILTER_MEAN    // ADC_FILTER_MEAN, ADC_FILTER_MEDIAN or ADC_FILTER_TRIMMED_MEAN
 
-#define CAPACITANCE               0.001f    // [F]
-#define RC_CONSTANT      CAPACITANCE*240    // RC constant (R = 150 ohm resistor + 33 ohm valve + 57 ohm other)
+#define CAPACITANCE                 1000    // [uF]
+#define RC_CONSTANT    (CAPACITANCE*240)    // [us] RC constant (R = 150 ohm resistor + 33 ohm valve + 57 ohm other)
 
 #define NOMINAL_SUPPLY_VOLTAGE      9000    // [mV]
 #define TYPICAL_SUPPLY_VOLTAGE      9350    // [mV] - value derived from tests
@@ -57,17 +74,38 @@
 
 #define VALVE_OPEN_PULSE_DURATION 250000    // [us] - pulse duration to open valve, Gardena valve timing: 250 ms
 #define VALVE_CLOSE_PULSE_DURATION 62500    // [us] - pulse duration to close valve, Gardena valve timing: 62.5 ms
+#define VALVE_OPEN_PULSE_MARGIN       50    // [ms] - default safety margin after detected latching of valve, 0 = always full open pulse
+#define LATCH_DETECT_MIN_TIME       5000    // [us] - ignore inductive current rise at start of open pulse
+#define LATCH_DETECT_INTERVAL       2000    // [us] - min. interval for charge current estimation
+#define LATCH_DETECT_TOLERANCE        20    // [mV/ms] - min. charge current recovery after dip caused by plunger movement
 #define MAX_DISCHARGE_TIMEOUT    1000000    // [us] - value derived from tests
 #define RECHARGE_TIMEOUT           90000    // [us] - value derived from tests
 
 #define MIN_RESISTANCE                25    // [ohm] - typically 40 ohm
 #define MAX_RESISTANCE                75    // [ohm] - typically 40 ohm
 
-#else
+#define CIRCUIT_SIMULATION             0    // 1 = simulate driver circuit at ADC input for operation without valve hardware
+#define SIM_VALVE_RESISTANCE          40    // [ohm] - simulated valve coil including connector, 0 = broken connector
+#define SIM_CAPACITANCE             1000    // [uF] - simulated capacitor
+#define SIM_SUPPLY_VOLTAGE          9350    // [mV] - simulated generator open circuit voltage
+#define SIM_SOURCE_RESISTANCE          2    // [ohm] - simulated generator internal resistance (supply sag)
+#define SIM_LATCH_TIME                30    // [ms] - simulated plunger movement after start of open pulse
 
-#define VALVE_OPEN_PULSE_DURATION 200000    // [us] - pulse duration to open valve, Gardena valve timing: 250 ms
-#define VALVE_CLOSE_PULSE_DURATION 62500    // [us] - pulse duration to close valve, Gardena valve timing: 62.5 ms
+// H-bridge and simulated valve driver (type 2 and 3)
+
+#define HBRIDGE_OPEN_PULSE_DURATION 200000  // [us] - default pulse duration to open valve, Gardena valve timing: 250 ms
+#define HBRIDGE_CLOSE_PULSE_DURATION 62500  // [us] - default pulse duration to close valve, Gardena valve timing: 62.5 ms
+#define GENERATOR_SETTLE_TIME       5000    // [us] - wait for generator voltage to stabilize before pulse
+#define VALVE_SHORT_TIME            1000    // [us] - short circuit valve current after pulse
+
+#define MIN_PULSE_DURATION         10000    // [us] - bounds of server configurable pulse profile
+#define MAX_PULSE_DURATION        500000    // [us]
+#define MAX_GENERATOR_SETTLE_TIME  25000    // [us]
+#define MAX_VALVE_SHORT_TIME       10000    // [us]
+
+#define VALVE_DRIVE_VOLTAGE         9000    // [mV] - H-bridge output voltage
+#define VALVE_NOMINAL_RESISTANCE      40    // [ohm] - typically 40 ohm
 
-#endif /* VALVE_DRIVER_TYPE == 1 */
+#define SIMULATED_OPEN_STATUS VALVE_STATUS_OK // status reported by simulated driver after open pulse
 
 #endif /* __USER_CONFIG_H__ */
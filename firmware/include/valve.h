@@ -1,6 +1,6 @@
 /*****************************************************************************
  *
- * Copyright (c) 2015-2019 jnsbyr
+ * Copyright (c) 2015-2026 jnsbyr
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -30,7 +30,16 @@
 #include "main.h"
 
 void   ICACHE_FLASH_ATTR valveDriverInit(void);
+char   ICACHE_FLASH_ATTR valveGetDriverId(void);
+void   ICACHE_FLASH_ATTR valvePrepare(SleeperStateT* sleeperState);
 uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode, uint64 startTime, uint8 toggleOverride, uint8 ignoreOverride);
+uint8  ICACHE_FLASH_ATTR valveIsAnyOpen(SleeperStateT* sleeperState);
+uint8  ICACHE_FLASH_ATTR valveGetStatus(SleeperStateT* sleeperState);
+#if MAX_VALVES > 1
+uint16 ICACHE_FLASH_ATTR valveFormat(SleeperStateT* sleeperState, char* buffer, uint16 size);
+#endif
+uint8  ICACHE_FLASH_ATTR valveIsBusy(void);
+void   ICACHE_FLASH_ATTR valveFinish(void);
 void   ICACHE_FLASH_ATTR valveDriverShutdown(void);
 
 #endif /* __USER_VALVE_H__ */
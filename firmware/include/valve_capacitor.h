@@ -0,0 +1,57 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2015-2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    valve_capacitor.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_VALVE_CAPACITOR_H__
+#define __USER_VALVE_CAPACITOR_H__
+
+// open Gardena latching valve using a 9 V step up converter and a capacitor
+//
+// GPIO  4 close valve         (push/pull, active high, floating in deep sleep)
+// GPIO  5 open valve          (open collector, active low, floating in deep sleep)
+// GPIO 13 charge capacitor    (open collector, active low)
+// GPIO 15 power supply enable (push/pull, active high, pulldown)
+
+// close valve output
+#define CLOSE_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO4_U
+#define CLOSE_VALVE_GPIO_FUNC FUNC_GPIO4
+#define CLOSE_VALVE_GPIO 4
+
+// open valve output works inverted!
+#define OPEN_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO5_U
+#define OPEN_VALVE_GPIO_FUNC FUNC_GPIO5
+#define OPEN_VALVE_GPIO 5
+
+// recharging capacitor output works inverted!
+#define CAPACITOR_GPIO_MUX PERIPHS_IO_MUX_MTCK_U
+#define CAPACITOR_GPIO_FUNC FUNC_GPIO13
+#define CAPACITOR_GPIO 13
+
+// enable generator output
+#define GENERATOR_GPIO_MUX PERIPHS_IO_MUX_MTDO_U
+#define GENERATOR_GPIO_FUNC FUNC_GPIO15
+#define GENERATOR_GPIO 15
+
+#endif /* __USER_VALVE_CAPACITOR_H__ */
@@ -0,0 +1,66 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    valve_driver.h
+ *
+ * created: 18.10.2026
+ *
+ *****************************************************************************/
+
+#ifndef __USER_VALVE_DRIVER_H__
+#define __USER_VALVE_DRIVER_H__
+
+#include "main.h"
+
+// valve operations are sequenced asynchronously in timer context
+#define VALVE_TIMER_PERIOD 5 // [ms] min. period of repeated os_timer
+#define VALVE_BUSY_WAIT    (2*1000UL*VALVE_TIMER_PERIOD) // [us] end of phase is busy-waited, os_timer may be late during WLAN activity
+
+/**
+ * valve driver operations
+ *
+ * open, close and prepare start a pulse sequence for the given valve, step
+ * continues the sequence in progress, all return true while the sequence is
+ * in progress; the driver updates the status and resistance of the valve
+ * when the sequence is completed
+ */
+typedef struct
+{
+  char  id;                                                            // firmware version suffix
+  void  (*init)(void);                                                 // called first at OS init
+  uint8 (*open)(SleeperStateT* sleeperState, ValveStateT* valve);      // start opening valve
+  uint8 (*close)(SleeperStateT* sleeperState, ValveStateT* valve);     // start closing valve
+  uint8 (*prepare)(SleeperStateT* sleeperState, ValveStateT* valve);   // optional, prepare closing valve
+  uint8 (*step)(SleeperStateT* sleeperState);                          // continue operation in progress
+  void  (*shutdown)(void);                                             // called last before OS shutdown
+} ValveDriverT;
+
+#if VALVE_DRIVER_TYPE < 1 || VALVE_DRIVER_TYPE > 3
+#error "selected VALVE_DRIVER_TYPE is not supported, choose 1 (capacitor), 2 (H-bridge) or 3 (simulated)"
+#endif
+
+// all drivers are built, VALVE_DRIVER_TYPE selects the driver of the board, @see valveDriverInit()
+extern const ValveDriverT capacitorDriver;
+extern const ValveDriverT hbridgeDriver;
+extern const ValveDriverT simulatedDriver;
+
+uint8 ICACHE_FLASH_ATTR valvePhaseElapsed(uint32 start, uint32 duration);
+
+#endif /* __USER_VALVE_DRIVER_H__ */
@@ -1,6 +1,6 @@
 /*****************************************************************************
  *
- * Copyright (c) 2015-2019 jnsbyr
+ * Copyright (c) 2015-2026 jnsbyr
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -22,95 +22,165 @@
  *
  * created: 30.12.2018
  *
+ *
+ * The capacitor voltage is oversampled with system_adc_read_fast and
+ * converted with integer math only. Initial samples are only discarded
+ * after the measurement at the capacitor was enabled and only until
+ * consecutive samples are within the settle tolerance.
+ *
  *****************************************************************************/
 
 #include "adc.h"
 
-#if VALVE_DRIVER_TYPE == 1
-
-#include <math.h>
 #include <eagle_soc.h>
 #include <gpio.h>
 #include <osapi.h>
 
-#define SAMPLES 20
+#include "circuit.h"
+
+#define ADC_CLOCK_DIVIDER 8 // system_adc_read_fast clock divider
 
 // ADC input
 #define ADC_GPIO_MUX PERIPHS_IO_MUX_MTDI_U
 #define ADC_GPIO_FUNC FUNC_GPIO12
 #define ADC_GPIO 12
 
-LOCAL uint16 buffer[SAMPLES];
-
-#endif /* VALVE_DRIVER_TYPE == 1 */
-
+LOCAL uint16 buffer[ADC_MAX_SAMPLES];
+LOCAL uint16 maxReadTime; // [us] max. duration of all readings since init
 
 /**
- * called at OS init
+ * called at OS init by capacitor driver
  */
 void ICACHE_FLASH_ATTR adcDriverInit()
 {
-#if VALVE_DRIVER_TYPE == 1
-
   // configure GPIO output
   PIN_FUNC_SELECT(ADC_GPIO_MUX, ADC_GPIO_FUNC);
 
   // initial output state: disable measurement at capacitor
   GPIO_OUTPUT_SET(ADC_GPIO, 0);
 
-#endif /* VALVE_DRIVER_TYPE == 1 */
+#if CIRCUIT_SIMULATION
+  circuitInit();
+#endif
 }
 
 /**
- * called before OS shutdown
+ * called before OS shutdown by capacitor driver
  */
 void ICACHE_FLASH_ATTR adcDriverShutdown()
 {
-#if VALVE_DRIVER_TYPE == 1
-
   // configure output state: disable measurement at capacitor
   GPIO_OUTPUT_SET(ADC_GPIO, 0);
 
-#endif /* VALVE_DRIVER_TYPE == 1 */
+#if CIRCUIT_SIMULATION
+  circuitReport();
+#endif
 }
 
-#if VALVE_DRIVER_TYPE == 1
+/**
+ * get max. duration of all ADC readings since init [us]
+ */
+uint16 ICACHE_FLASH_ATTR adcGetMaxReadTime()
+{
+  return maxReadTime;
+}
 
 /**
  * read TOUT input
  *
- * 20 samples take about 1.8 ms
+ * each sample takes about 90 us, settling is only required after enabling
+ * the measurement at the capacitor
  *
  * @return voltage at ADC input divider [mV]
  */
 uint16 adcRead()
 {
-  // enable measurement at capacitor
+  uint32 t0 = system_get_time(); // [us]
+
+  // enable measurement at capacitor, input voltage must settle
+  uint8 settle = 0;
   if (!GPIO_INPUT_GET(ADC_GPIO))
   {
     GPIO_OUTPUT_SET(ADC_GPIO, 1);
+    settle = ADC_SETTLE_SAMPLES;
   }
 
   // oversample ADC
-  system_adc_read_fast(buffer, SAMPLES, 8);
+  uint8 count = settle + ADC_SAMPLES;
+#if CIRCUIT_SIMULATION
+  circuitSample(buffer, count);
+#else
+  system_adc_read_fast(buffer, count, ADC_CLOCK_DIVIDER);
+#endif
+
+  // skipping initial samples until input is stable is faster than a delay for input voltage to settle
+  uint8 first = 0;
+  while (first < settle)
+  {
+    uint16 delta = buffer[first + 1] > buffer[first]? buffer[first + 1] - buffer[first] : buffer[first] - buffer[first + 1];
+    first++;
+    if (delta <= ADC_SETTLE_TOLERANCE)
+    {
+      break;
+    }
+  }
+  uint16* samples = &buffer[first];
+  count -= first;
+
+  // sort samples for rejection filters
+  if (ADC_FILTER != ADC_FILTER_MEAN)
+  {
+    for (uint8 i=1; i<count; i++)
+    {
+      uint16 sample = samples[i];
+      uint8 j = i;
+      for (; j>0 && samples[j-1] > sample; j--)
+      {
+        samples[j] = samples[j-1];
+      }
+      samples[j] = sample;
+    }
+  }
 
-  // skipping initial samples is faster than a delay for input voltage to settle
+  // reduce samples
   uint32 sum = 0;
-  uint16 skip = 10;
-  for (uint16 i=0; i<SAMPLES; i++)
+  uint8 used = 0;
+  switch (ADC_FILTER)
   {
-    //ets_uart_printf("ADC %d=%u\r\n", i, buffer[i]);
-    if (i >= skip)
+    case ADC_FILTER_MEDIAN:
+      sum  = count%2? 2*samples[count/2] : samples[count/2 - 1] + samples[count/2];
+      used = 2;
+      break;
+
+    case ADC_FILTER_TRIMMED_MEAN:
     {
-      sum += buffer[i];
+      uint8 trim = count/4;
+      for (uint8 i=trim; i<count - trim; i++)
+      {
+        sum += samples[i];
+      }
+      used = count - 2*trim;
+      break;
     }
+
+    default:
+      for (uint8 i=0; i<count; i++)
+      {
+        sum += samples[i];
+      }
+      used = count;
   }
 
-  // ADC samples -> input voltage
-  uint16 average = round((float)sum/(SAMPLES - skip)/1024*1000*ADC_DIVIDER_RATIO); // [mV]
-  //ets_uart_printf("ADC avg=%u\r\n", average);
+  // ADC samples -> input voltage with rounding (10 bit ADC, 1 V reference)
+  uint16 average = (sum*(1000*ADC_DIVIDER_RATIO) + 512U*used)/(1024U*used); // [mV]
+  //LOG_DEBUG("ADC avg=%u\r\n", average);
+
+  // update timing
+  uint32 duration = system_get_time() - t0;
+  if (duration > maxReadTime)
+  {
+    maxReadTime = duration < 0xFFFF? duration : 0xFFFF;
+  }
 
   return average;
 }
-
-#endif /* VALVE_DRIVER_TYPE == 1 */
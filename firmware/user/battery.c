@@ -0,0 +1,268 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    battery.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * The battery voltage measured at boot is smoothed and sampled into a
+ * voltage history every BATTERY_SAMPLE_INTERVAL. The charge drawn from the
+ * battery is estimated from the awake time of each wake cycle and the
+ * duration of each deep sleep using typical currents of the circuit and is
+ * accumulated since the last cold boot (battery change).
+ *
+ * The remaining runtime is predicted twice: from the remaining capacity
+ * and the charge used per day at the configured downtime and from the
+ * least squares trend of the voltage history extrapolated to
+ * MIN_BATTERY_VOLTAGE. The regulated supply voltage typically stays flat
+ * until the battery is almost empty, so the capacity based prediction is
+ * relevant first and the voltage trend takes over when the voltage starts
+ * to decline. The lower of both predictions is reported.
+ *
+ * When the predicted runtime falls below the configured number of days
+ * the regular downtime is stretched linearly up to the configured factor
+ * at 0 days. Wakeups for scheduled valve events are not affected because
+ * the downtime is cut back to hit the next event anyway.
+ *
+ * The awake charge is also limited by an energy budget per wake cycle and
+ * per day. The awake time of a wake cycle is limited to the lower of the
+ * wake budget and the share of the remaining day budget per remaining wake
+ * cycle of the day, but not below MIN_AWAKE_BUDGET. When the awake time
+ * is used up, the uplink is abandoned while valve operations still
+ * complete.
+ *
+ *****************************************************************************/
+
+#include "battery.h"
+
+#include <osapi.h>
+
+/**
+ * clear battery model, e.g. after cold boot caused by battery change
+ */
+void ICACHE_FLASH_ATTR batteryReset(SleeperStateT* sleeperState)
+{
+  sleeperState->rtcMem.batteryLevel       = 0;
+  sleeperState->rtcMem.wakeCharge         = 0;
+  sleeperState->rtcMem.batteryConsumed    = 0;
+  sleeperState->rtcMem.batteryElapsed     = 0;
+  sleeperState->rtcMem.batterySampleCount = 0;
+  sleeperState->rtcMem.batterySampleNext  = 0;
+  sleeperState->rtcMem.dayCharge          = 0;
+  sleeperState->rtcMem.budgetCuts         = 0;
+  sleeperState->rtcMem.budgetDay          = 0;
+}
+
+/**
+ * account deep sleep duration [ms] and smooth battery voltage measured at boot
+ */
+void ICACHE_FLASH_ATTR batteryAddSleep(SleeperStateT* sleeperState, uint32 slept)
+{
+  // charge drawn while sleeping
+  sleeperState->rtcMem.batteryConsumed += ((uint64)slept*SLEEP_CURRENT + 500000)/1000000; // [mAs]
+
+  // smooth battery voltage (EWMA 1/8)
+  if (sleeperState->batteryVoltage <= 0)
+  {
+    return;
+  }
+  sint32 level = sleeperState->batteryVoltage << 3; // [mV] Q3
+  if (sleeperState->rtcMem.batteryLevel)
+  {
+    level = sleeperState->rtcMem.batteryLevel + (level - sleeperState->rtcMem.batteryLevel)/8;
+  }
+  sleeperState->rtcMem.batteryLevel = level;
+
+  // add voltage history sample
+  sleeperState->rtcMem.batteryElapsed += slept/1000;
+  if (sleeperState->rtcMem.batterySampleCount == 0 || sleeperState->rtcMem.batteryElapsed >= BATTERY_SAMPLE_INTERVAL)
+  {
+    uint16 voltage = (level + 4) >> 3; // [mV]
+    sleeperState->rtcMem.batterySamples[sleeperState->rtcMem.batterySampleNext] = voltage;
+    sleeperState->rtcMem.batterySampleNext = (sleeperState->rtcMem.batterySampleNext + 1)%BATTERY_SAMPLES;
+    if (sleeperState->rtcMem.batterySampleCount < BATTERY_SAMPLES)
+    {
+      sleeperState->rtcMem.batterySampleCount++;
+    }
+    sleeperState->rtcMem.batteryElapsed = sleeperState->rtcMem.batteryElapsed >= BATTERY_SAMPLE_INTERVAL? sleeperState->rtcMem.batteryElapsed - BATTERY_SAMPLE_INTERVAL : 0;
+    LOG_INFO("battery: %u mV, %lu mAh used\r\n", voltage, sleeperState->rtcMem.batteryConsumed/3600);
+  }
+}
+
+/**
+ * account awake time [ms] of current wake cycle
+ */
+void ICACHE_FLASH_ATTR batteryAddWake(SleeperStateT* sleeperState, uint32 uptime)
+{
+  uint32 charge = ((uint64)uptime*AWAKE_CURRENT + 500)/1000; // [mAs]
+  sleeperState->rtcMem.batteryConsumed += charge;
+  sleeperState->rtcMem.dayCharge = charge < 0xFFFFUL - sleeperState->rtcMem.dayCharge? sleeperState->rtcMem.dayCharge + charge : 0xFFFF;
+
+  // smooth charge per wake cycle (EWMA 1/4)
+  if (charge > 0xFFFF)
+  {
+    charge = 0xFFFF;
+  }
+  if (sleeperState->rtcMem.wakeCharge)
+  {
+    charge = (3*sleeperState->rtcMem.wakeCharge + charge + 2)/4;
+  }
+  sleeperState->rtcMem.wakeCharge = charge;
+}
+
+/**
+ * start energy budget of current wake cycle
+ *
+ * @return milliseconds of uptime until uplink is abandoned, 0xFFFFFFFF = unlimited
+ */
+uint32 ICACHE_FLASH_ATTR batteryStartWake(SleeperStateT* sleeperState)
+{
+  PersistentStateT* rtcMem = &sleeperState->rtcMem;
+
+  // new day
+  uint8 day = sleeperState->now/(1000ULL*SECONDS_PER_DAY);
+  if (day != rtcMem->budgetDay)
+  {
+    rtcMem->budgetDay  = day;
+    rtcMem->dayCharge  = 0;
+    rtcMem->budgetCuts = 0;
+  }
+
+  uint32 budget = rtcMem->wakeBudget? rtcMem->wakeBudget : 0xFFFFFFFF; // [mAs]
+  if (rtcMem->dayBudget)
+  {
+    // share of remaining day budget per remaining wake cycle of day
+    uint32 remaining = rtcMem->dayCharge < rtcMem->dayBudget? rtcMem->dayBudget - rtcMem->dayCharge : 0; // [mAs]
+    uint32 awake = rtcMem->wakeCharge? 1000UL*rtcMem->wakeCharge/AWAKE_CURRENT : SLEEPER_COMMANDTIME; // [ms]
+    uint32 left = 1000UL*SECONDS_PER_DAY - sleeperState->now%(1000ULL*SECONDS_PER_DAY); // [ms]
+    uint32 cycles = left/(rtcMem->downtime + rtcMem->boottime + awake) + 1;
+    if (remaining/cycles < budget)
+    {
+      budget = remaining/cycles;
+    }
+  }
+  if (budget == 0xFFFFFFFF)
+  {
+    return budget;
+  }
+
+  // charge -> uptime
+  uint32 uptime = 1000UL*budget/AWAKE_CURRENT; // [ms]
+  uptime = uptime > rtcMem->boottime + MIN_AWAKE_BUDGET? uptime - rtcMem->boottime : MIN_AWAKE_BUDGET;
+  LOG_INFO("battery: awake budget %lu ms, %u of %u mAs used today\r\n", uptime, rtcMem->dayCharge, rtcMem->dayBudget);
+
+  return uptime;
+}
+
+/**
+ * get least squares slope of voltage history
+ *
+ * @return mV per day Q8, 0 if not enough samples are available
+ */
+LOCAL sint32 ICACHE_FLASH_ATTR getTrend(SleeperStateT* sleeperState)
+{
+  uint8 count = sleeperState->rtcMem.batterySampleCount;
+  if (count < BATTERY_MIN_TREND)
+  {
+    return 0;
+  }
+
+  // oldest sample first, x = sample index
+  uint8 first = count < BATTERY_SAMPLES? 0 : sleeperState->rtcMem.batterySampleNext;
+  sint32 sumY = 0;
+  sint32 sumXY = 0;
+  for (uint8 i=0; i<count; i++)
+  {
+    sint32 y = sleeperState->rtcMem.batterySamples[(first + i)%BATTERY_SAMPLES];
+    sumY += y;
+    sumXY += i*y;
+  }
+  sint32 n = count;
+  sint32 sumX = n*(n - 1)/2;
+  sint32 sumXX = n*(n - 1)*(2*n - 1)/6;
+  return ((n*sumXY - sumX*sumY)*(256*SECONDS_PER_DAY/BATTERY_SAMPLE_INTERVAL))/(n*sumXX - sumX*sumX);
+}
+
+/**
+ * predict remaining runtime until battery voltage falls below MIN_BATTERY_VOLTAGE
+ *
+ * @return days, -1 if unknown
+ */
+sint16 ICACHE_FLASH_ATTR batteryGetDays(SleeperStateT* sleeperState)
+{
+  uint32 days = 0xFFFFFFFF;
+
+  // remaining capacity at charge used per day with configured downtime
+  uint32 wakeCharge = sleeperState->rtcMem.wakeCharge; // [mAs]
+  if (wakeCharge)
+  {
+    uint32 capacity = 3600UL*BATTERY_CAPACITY; // [mAs]
+    uint32 awake = 1000UL*wakeCharge/AWAKE_CURRENT; // [ms]
+    uint32 cycles = 1000UL*SECONDS_PER_DAY/(sleeperState->rtcMem.downtime + sleeperState->rtcMem.boottime + awake + 1);
+    uint64 dailyCharge = (uint64)cycles*wakeCharge + SECONDS_PER_DAY*SLEEP_CURRENT/1000; // [mAs]
+    days = sleeperState->rtcMem.batteryConsumed < capacity? (capacity - sleeperState->rtcMem.batteryConsumed)/dailyCharge : 0;
+  }
+
+  // extrapolated voltage trend
+  sint32 trend = getTrend(sleeperState); // [mV/day] Q8
+  if (trend < 0)
+  {
+    sint32 margin = ((sleeperState->rtcMem.batteryLevel + 4) >> 3) - MIN_BATTERY_VOLTAGE; // [mV]
+    uint32 trendDays = margin > 0? 256*margin/-trend : 0;
+    if (trendDays < days)
+    {
+      days = trendDays;
+    }
+  }
+
+  return days < 0x7FFF? days : (wakeCharge? 0x7FFF : -1);
+}
+
+/**
+ * get downtime stretched depending on predicted battery runtime
+ *
+ * @return milliseconds
+ */
+uint32 ICACHE_FLASH_ATTR batteryGetDowntime(SleeperStateT* sleeperState)
+{
+  uint32 downtime = sleeperState->rtcMem.downtime; // [ms]
+  sint16 days = batteryGetDays(sleeperState);
+  uint8 stretchDays = sleeperState->rtcMem.stretchDays;
+  if (days < 0 || days >= stretchDays || sleeperState->rtcMem.maxStretch <= 100)
+  {
+    return downtime;
+  }
+
+  // stretch factor increases linearly from 100 % at stretchDays to maxStretch at 0 days
+  uint32 stretch = 100 + (uint32)(sleeperState->rtcMem.maxStretch - 100)*(stretchDays - days)/stretchDays; // [%]
+  uint64 stretched = (uint64)downtime*stretch/100; // [ms]
+  if (stretched > MAX_STRETCHED_DOWNTIME)
+  {
+    stretched = MAX_STRETCHED_DOWNTIME;
+  }
+  if (stretched > downtime)
+  {
+    LOG_INFO("battery: %d days left, downtime stretched to %lu s\r\n", days, (uint32)(stretched/1000));
+    downtime = stretched;
+  }
+
+  return downtime;
+}
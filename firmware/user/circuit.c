@@ -0,0 +1,207 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    circuit.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * Model of the capacitor valve driver circuit for operating the capacitor
+ * driver on a bare ESP8266 module (CIRCUIT_SIMULATION). The GPIO output
+ * registers set by the driver select the current path and the capacitor
+ * voltage follows the RC step response of that path:
+ *
+ *   generator + open valve      charge via valve coil
+ *   generator + charge          charge via bypass
+ *   generator + close valve     discharge via valve coil and resistor
+ *   close valve                 discharge via valve coil
+ *
+ * The back EMF of the moving plunger is modelled as a temporary increase of
+ * the coil resistance after the configured latch time. adcRead gets the
+ * capacitor voltage as raw ADC samples with 1 LSB noise, so the sampling,
+ * filtering and classification of the driver run unchanged. The ADC
+ * conversion time is not simulated. The energy drawn from the generator
+ * and the simulated valve state are logged at shutdown to compare with
+ * the valve status reported by the driver.
+ *
+ *****************************************************************************/
+
+#include "circuit.h"
+
+#if CIRCUIT_SIMULATION
+
+#include <eagle_soc.h>
+#include <gpio.h>
+#include <osapi.h>
+
+#include "fixmath.h"
+#include "valve_capacitor.h"
+
+#define BYPASS_RESISTANCE     18                                // [ohm] capacitor recharge path
+#define DISCHARGE_RESISTANCE  (RC_CONSTANT/CAPACITANCE - 33)   // [ohm] resistor path without valve, @see RC_CONSTANT
+#define LATCH_DIP_TIME      4000                                // [us] duration of back EMF while plunger moves
+#define LATCH_DIP_FACTOR       3                                // coil resistance factor while plunger moves
+#define CLOSE_LATCH_TIME   10000                                // [us] min. close pulse duration to release plunger
+
+LOCAL CircuitConfigT circuitConfig = {SIM_VALVE_RESISTANCE, SIM_CAPACITANCE, SIM_SUPPLY_VOLTAGE, SIM_SOURCE_RESISTANCE, SIM_LATCH_TIME};
+
+LOCAL uint32 lastUpdate;     // [us]
+LOCAL uint32 voltage;        // [uV] capacitor voltage
+LOCAL uint32 pulseTime;      // [us] duration of current valve pulse
+LOCAL uint64 energy;         // [uJ] drawn from generator
+LOCAL uint8  valveOpen;      // bool, plunger position
+LOCAL uint32 noise = 1;      // pseudo random noise generator state
+
+/**
+ * called at OS init
+ */
+void ICACHE_FLASH_ATTR circuitInit()
+{
+  lastUpdate = system_get_time();
+  LOG_INFO("circuit: simulated, R=%u ohm, C=%u uF, U=%u mV, Rs=%u ohm\r\n", circuitConfig.resistance, circuitConfig.capacitance,
+           circuitConfig.supplyVoltage, circuitConfig.sourceResistance);
+}
+
+/**
+ * change circuit parameters, a valve resistance of 0 simulates a broken connector
+ */
+void ICACHE_FLASH_ATTR circuitConfigure(const CircuitConfigT* config)
+{
+  circuitConfig = *config;
+  if (circuitConfig.capacitance < 1)
+  {
+    circuitConfig.capacitance = 1;
+  }
+}
+
+/**
+ * advance capacitor voltage to current time based on GPIO output state
+ */
+LOCAL void ICACHE_FLASH_ATTR update()
+{
+  uint32 now = system_get_time();
+  uint32 dt = now - lastUpdate; // [us]
+  lastUpdate = now;
+
+  uint32 out    = GPIO_REG_READ(GPIO_OUT_ADDRESS);
+  uint32 enable = GPIO_REG_READ(GPIO_ENABLE_ADDRESS);
+  uint8 generator = (enable & out & BIT(GENERATOR_GPIO)) != 0;
+  uint8 close     = (enable & out & BIT(CLOSE_VALVE_GPIO)) != 0;
+  uint8 open      = (enable & ~out & BIT(OPEN_VALVE_GPIO)) != 0;
+  uint8 charge    = (enable & ~out & BIT(CAPACITOR_GPIO)) != 0;
+  uint8 connected = circuitConfig.resistance > 0;
+
+  // back EMF of moving plunger
+  uint32 coil = circuitConfig.resistance; // [ohm]
+  if (open && connected && !valveOpen && pulseTime >= 1000UL*circuitConfig.latchTime)
+  {
+    coil *= LATCH_DIP_FACTOR;
+  }
+
+  // select current path
+  uint32 target = 0;     // [uV]
+  uint32 resistance = 0; // [ohm], 0 = no current
+  if (close && generator)
+  {
+    resistance = connected? DISCHARGE_RESISTANCE + coil : 0;
+  }
+  else if (close)
+  {
+    resistance = coil;
+  }
+  else if (open && generator)
+  {
+    target = 1000UL*circuitConfig.supplyVoltage;
+    resistance = connected? coil + circuitConfig.sourceResistance : 0;
+  }
+  else if (charge && generator)
+  {
+    target = 1000UL*circuitConfig.supplyVoltage;
+    resistance = BYPASS_RESISTANCE + circuitConfig.sourceResistance;
+  }
+
+  // RC step response: U = Uinf + (U0 - Uinf)*e^(-t/tau)
+  if (resistance)
+  {
+    uint32 tau = resistance*circuitConfig.capacitance; // [us]
+    uint32 x = dt < tau*64UL? ((uint64)dt << 16)/tau : 64UL*FIX_ONE; // Q16.16
+    uint32 decay = fixExpNeg(x); // Q16.16
+    uint32 previous = voltage;
+    if (voltage > target)
+    {
+      voltage = target + (((uint64)(voltage - target)*decay) >> 16);
+    }
+    else
+    {
+      voltage = target - (((uint64)(target - voltage)*decay) >> 16);
+    }
+
+    // energy drawn from generator: E = Uinf*C*dU
+    if (target > previous)
+    {
+      energy += (uint64)circuitConfig.supplyVoltage*circuitConfig.capacitance*(voltage - previous)/1000000000ULL; // [uJ]
+    }
+  }
+
+  // plunger movement by current through valve coil
+  uint8 coilCurrent = connected && ((open && generator) || close);
+  pulseTime = coilCurrent? pulseTime + dt : 0;
+  if (coilCurrent && open && !valveOpen && pulseTime >= 1000UL*circuitConfig.latchTime + LATCH_DIP_TIME)
+  {
+    valveOpen = true;
+    LOG_INFO("circuit: valve opened after %lu us\r\n", pulseTime);
+  }
+  else if (coilCurrent && close && valveOpen && pulseTime >= CLOSE_LATCH_TIME)
+  {
+    valveOpen = false;
+    LOG_INFO("circuit: valve closed after %lu us\r\n", pulseTime);
+  }
+}
+
+/**
+ * replacement for system_adc_read_fast
+ *
+ * @param buffer raw ADC samples (10 bit, 1 V reference) of capacitor voltage
+ * @param count number of samples
+ */
+void ICACHE_FLASH_ATTR circuitSample(uint16* buffer, uint8 count)
+{
+  update();
+
+  // capacitor voltage at ADC input divider -> ADC samples
+  uint32 sample = ((uint64)voltage*1024 + 500000UL*ADC_DIVIDER_RATIO)/(1000000UL*ADC_DIVIDER_RATIO);
+  for (uint8 i=0; i<count; i++)
+  {
+    noise = 1103515245UL*noise + 12345;
+    uint32 value = sample + ((noise >> 16)%3) - 1;
+    buffer[i] = value > 1023? (sample? 1023 : 0) : value;
+  }
+}
+
+/**
+ * called before OS shutdown
+ */
+void ICACHE_FLASH_ATTR circuitReport()
+{
+  update();
+  LOG_INFO("circuit: valve %s, capacitor %lu mV, generator %lu mJ\r\n", valveOpen? "open" : "closed", voltage/1000, (uint32)(energy/1000));
+}
+
+#endif /* CIRCUIT_SIMULATION */
@@ -0,0 +1,279 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    discovery.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * The address of the control server is cached in RTC memory and in a flash
+ * sector, so regular wake cycles and cold boots connect directly. Only if
+ * no server is cached, a SleeperDiscovery telegram is broadcast via UDP to
+ * DISCOVERY_PORT after the WLAN link is up:
+ *
+ *   {"name":"SleeperDiscovery", "version":"..."}
+ *
+ * The server replies to the sender with its TCP port, the server address is
+ * taken from the sender of the reply:
+ *
+ *   {"name":"SleeperServer", "port":3030, "token":"..."}
+ *
+ * Replies are only accepted from the local subnet of the station interface
+ * and if the token matches DISCOVERY_TOKEN, because the discovered server is
+ * cached and controls the valves. The token is not part of the broadcast.
+ *
+ * If no server replies within MAX_DISCOVERY_TIME, REMOTE_IP and REMOTE_PORT
+ * are cached instead. After DISCOVERY_FAILURES consecutive uplinks without
+ * reply from the cached server while the WLAN link was up, the cache is
+ * cleared and the server is discovered again in the next wake cycle.
+ *
+ *****************************************************************************/
+
+#include "discovery.h"
+
+#include <ip_addr.h>
+#include <espconn.h>
+#include <osapi.h>
+#include <user_interface.h>
+#include <json/jsonparse.h>
+
+#define DISCOVERY_MAGIC 0x5344
+
+typedef struct          // 8 Byte
+{
+  uint16 magic;
+  uint16 port;          // TCP port of server
+  uint32 ip;            // IPv4 address of server
+} DiscoveryT;
+
+LOCAL struct espconn connection;
+LOCAL esp_udp udp;
+LOCAL uint8 active;       // bool, UDP socket created
+LOCAL uint32 startTime;   // [us]
+LOCAL uint32 replyIp;     // IPv4 address of replying server, 0 = no reply
+LOCAL uint16 replyPort;
+LOCAL char txPayload[64];
+
+/**
+ * UDP receive callback, accept first valid server reply
+ */
+LOCAL void ICACHE_FLASH_ATTR receiveCallback(void *arg, char *pdata, unsigned short len)
+{
+  struct espconn *pespconn = arg;
+  remot_info* remote = NULL;
+  if (replyIp || espconn_get_connection_info(pespconn, &remote, 0) != ESPCONN_OK || remote == NULL)
+  {
+    return;
+  }
+
+  // only accept servers from local subnet
+  struct ip_info ipInfo;
+  uint32 remoteIp;
+  os_memcpy(&remoteIp, remote->remote_ip, 4);
+  if (!wifi_get_ip_info(STATION_IF, &ipInfo) || ((remoteIp ^ ipInfo.ip.addr) & ipInfo.netmask.addr))
+  {
+    LOG_WARNING("WARNING: UDP discovery reply from " IPSTR " outside of local subnet ignored\r\n", IP2STR(&remoteIp));
+    return;
+  }
+
+  char buffer[32];
+  uint8 isServer = false;
+  uint8 tokenValid = false;
+  uint16 port = REMOTE_PORT;
+  int type;
+  struct jsonparse_state jsonParser;
+  jsonparse_setup(&jsonParser, pdata, len);
+  while ((type = jsonparse_next(&jsonParser)) != JSON_TYPE_ERROR)
+  {
+    if (type == JSON_TYPE_PAIR_NAME)
+    {
+      if (jsonparse_strcmp_value(&jsonParser, "name") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        jsonparse_copy_value(&jsonParser, buffer, sizeof(buffer));
+        isServer = os_strcmp(buffer, "SleeperServer") == 0;
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "token") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        jsonparse_copy_value(&jsonParser, buffer, sizeof(buffer));
+        tokenValid = os_strcmp(buffer, DISCOVERY_TOKEN) == 0;
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "port") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int value = jsonparse_get_value_as_int(&jsonParser);
+        if (value > 0 && value <= 0xFFFF)
+        {
+          port = value;
+        }
+      }
+    }
+  }
+
+  if (isServer && !tokenValid)
+  {
+    LOG_WARNING("WARNING: UDP discovery reply from " IPSTR " with invalid token ignored\r\n", IP2STR(&remoteIp));
+  }
+  else if (isServer)
+  {
+    replyIp = remoteIp;
+    replyPort = port;
+    LOG_INFO("UDP discovered server " IPSTR ":%u after %lu ms\r\n", IP2STR(&replyIp), replyPort, (system_get_time() - startTime)/1000);
+
+    // trigger reply processing
+    comProcessing();
+  }
+}
+
+/**
+ * restore cached server from flash after cold boot
+ */
+void ICACHE_FLASH_ATTR discoveryLoad(SleeperStateT* sleeperState)
+{
+  DiscoveryT discovery;
+  sleeperState->rtcMem.serverIp = 0;
+  sleeperState->rtcMem.serverPort = 0;
+  sleeperState->rtcMem.serverFailures = 0;
+  if (spi_flash_read(getUserDataSector(DISCOVERY_FLASH_SECTOR)*SPI_FLASH_SEC_SIZE, (uint32*)&discovery, sizeof(discovery)) == SPI_FLASH_RESULT_OK
+      && discovery.magic == DISCOVERY_MAGIC && discovery.ip)
+  {
+    sleeperState->rtcMem.serverIp = discovery.ip;
+    sleeperState->rtcMem.serverPort = discovery.port;
+    LOG_INFO("server " IPSTR ":%u restored\r\n", IP2STR(&sleeperState->rtcMem.serverIp), sleeperState->rtcMem.serverPort);
+  }
+}
+
+/**
+ * broadcast discovery telegram if no server is cached
+ *
+ * @return true if discovery is in progress
+ */
+uint8 ICACHE_FLASH_ATTR discoveryStart(SleeperStateT* sleeperState, const char* version)
+{
+  if (sleeperState->rtcMem.serverIp)
+  {
+    return false;
+  }
+
+  replyIp = 0;
+  replyPort = 0;
+  startTime = system_get_time();
+
+  // define UDP broadcast connection
+  connection.type      = ESPCONN_UDP;
+  connection.state     = ESPCONN_NONE;
+  connection.proto.udp = &udp;
+  udp.local_port  = espconn_port();
+  udp.remote_port = DISCOVERY_PORT;
+  os_memset(udp.remote_ip, 0xFF, 4);
+  espconn_regist_recvcb(&connection, receiveCallback);
+  if (espconn_create(&connection) != ESPCONN_OK)
+  {
+    LOG_ERROR("ERROR: UDP create failed\r\n");
+    return false;
+  }
+  active = true;
+
+  uint16 length = os_sprintf(txPayload, "{\"name\":\"SleeperDiscovery\", \"version\":\"%s\"}", version);
+  LOG_INFO("UDP broadcasting server discovery to port %u\r\n", DISCOVERY_PORT);
+  if (espconn_sent(&connection, (uint8*)txPayload, length) != ESPCONN_OK)
+  {
+    LOG_ERROR("ERROR: UDP send failed\r\n");
+  }
+
+  return true;
+}
+
+/**
+ * check for server reply or timeout and cache result
+ *
+ * @return true if discovery is completed
+ */
+uint8 ICACHE_FLASH_ATTR discoveryCheck(SleeperStateT* sleeperState)
+{
+  if (!replyIp && system_get_time() - startTime < 1000UL*MAX_DISCOVERY_TIME)
+  {
+    return false;
+  }
+
+  if (active)
+  {
+    espconn_delete(&connection);
+    active = false;
+  }
+
+  if (replyIp)
+  {
+    // save discovered server to flash if changed
+    DiscoveryT discovery;
+    uint32 sector = getUserDataSector(DISCOVERY_FLASH_SECTOR);
+    if (spi_flash_read(sector*SPI_FLASH_SEC_SIZE, (uint32*)&discovery, sizeof(discovery)) != SPI_FLASH_RESULT_OK
+        || discovery.magic != DISCOVERY_MAGIC || discovery.ip != replyIp || discovery.port != replyPort)
+    {
+      if (discovery.magic == DISCOVERY_MAGIC && discovery.ip)
+      {
+        LOG_WARNING("WARNING: cached server " IPSTR ":%u replaced by " IPSTR ":%u\r\n", IP2STR(&discovery.ip), discovery.port, IP2STR(&replyIp), replyPort);
+      }
+      discovery.magic = DISCOVERY_MAGIC;
+      discovery.port  = replyPort;
+      discovery.ip    = replyIp;
+      if (spi_flash_erase_sector(sector) != SPI_FLASH_RESULT_OK
+          || spi_flash_write(sector*SPI_FLASH_SEC_SIZE, (uint32*)&discovery, sizeof(discovery)) != SPI_FLASH_RESULT_OK)
+      {
+        LOG_ERROR("ERROR: writing server to flash failed\r\n");
+      }
+    }
+    sleeperState->rtcMem.serverIp   = replyIp;
+    sleeperState->rtcMem.serverPort = replyPort;
+  }
+  else
+  {
+    // no reply, use default server until it fails
+    LOG_WARNING("WARNING: UDP server discovery timeout, using default server\r\n");
+    sleeperState->rtcMem.serverIp   = ipaddr_addr(REMOTE_IP);
+    sleeperState->rtcMem.serverPort = REMOTE_PORT;
+  }
+  sleeperState->rtcMem.serverFailures = 0;
+
+  return true;
+}
+
+/**
+ * track replies of cached server, clear cache after DISCOVERY_FAILURES consecutive failures
+ *
+ * @param replied true if server replied, false if server did not reply while WLAN link was up
+ */
+void ICACHE_FLASH_ATTR discoveryUplinkResult(SleeperStateT* sleeperState, uint8 replied)
+{
+  if (replied)
+  {
+    sleeperState->rtcMem.serverFailures = 0;
+  }
+  else if (++sleeperState->rtcMem.serverFailures >= DISCOVERY_FAILURES)
+  {
+    LOG_WARNING("WARNING: server " IPSTR " not replying, discovering again\r\n", IP2STR(&sleeperState->rtcMem.serverIp));
+    sleeperState->rtcMem.serverIp = 0;
+    sleeperState->rtcMem.serverFailures = 0;
+  }
+}
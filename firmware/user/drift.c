@@ -0,0 +1,254 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    drift.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * The deep sleep timer of the ESP8266 does not run at its nominal rate.
+ * If the sleep duration can be measured with the RTC counter the error of
+ * the requested sleep duration is accumulated at each wakeup. Otherwise the
+ * clock error is observed each time the server time is received and
+ * compared with the requested sleep duration since the previous
+ * observation. Every sample is stored as the downtime scale that would have
+ * compensated the error, so samples remain valid when the scale changes.
+ * The downtime scale is the sleep weighted mean of all samples.
+ *
+ *****************************************************************************/
+
+#include "drift.h"
+
+#include <osapi.h>
+
+/**
+ * integer square root
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR isqrt(uint32 x)
+{
+  uint32 root = 0;
+  uint32 bit = 1UL << 30;
+  while (bit > x)
+  {
+    bit >>= 2;
+  }
+  while (bit)
+  {
+    if (x >= root + bit)
+    {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/**
+ * sleep weighted mean of drift samples
+ */
+LOCAL uint16 ICACHE_FLASH_ATTR getMeanScale(SleeperStateT* sleeperState)
+{
+  uint32 weights = 0;
+  uint64 sum = 0;
+  for (uint8 i=0; i<sleeperState->rtcMem.driftSampleCount; i++)
+  {
+    DriftSampleT* sample = &sleeperState->rtcMem.driftSamples[i];
+    weights += sample->slept;
+    sum += (uint64)sample->slept*sample->scale;
+  }
+  return weights? (sum + weights/2)/weights : sleeperState->rtcMem.downtimeScale;
+}
+
+/**
+ * clear drift history, e.g. after cold boot or manual downtime scale change
+ */
+void ICACHE_FLASH_ATTR driftReset(SleeperStateT* sleeperState)
+{
+  sleeperState->rtcMem.driftSampleCount = 0;
+  sleeperState->rtcMem.driftSampleNext  = 0;
+  driftInvalidate(sleeperState);
+}
+
+/**
+ * accumulate requested sleep duration of last deep sleep [ms]
+ */
+void ICACHE_FLASH_ATTR driftAddSleep(SleeperStateT* sleeperState, uint32 slept)
+{
+  if (sleeperState->rtcMem.driftBaseline && sleeperState->rtcMem.driftMeasured)
+  {
+    // sample was started with RTC counter measurement
+    driftInvalidate(sleeperState);
+  }
+  else if (sleeperState->rtcMem.driftBaseline)
+  {
+    if (slept <= 0xFFFFFFFFUL - sleeperState->rtcMem.driftSlept)
+    {
+      sleeperState->rtcMem.driftSlept += slept;
+    }
+    else
+    {
+      // no server contact for weeks, start over
+      driftInvalidate(sleeperState);
+    }
+  }
+}
+
+/**
+ * discard current sample, e.g. if the sleep duration is unknown because of a user wakeup
+ */
+void ICACHE_FLASH_ATTR driftInvalidate(SleeperStateT* sleeperState)
+{
+  sleeperState->rtcMem.driftBaseline = false;
+  sleeperState->rtcMem.driftMeasured = false;
+  sleeperState->rtcMem.driftError    = 0;
+  sleeperState->rtcMem.driftSlept    = 0;
+}
+
+/**
+ * add drift sample, fit downtime scale and start next sample
+ */
+LOCAL void ICACHE_FLASH_ATTR addSample(SleeperStateT* sleeperState, sint32 error)
+{
+  // add sample if error is plausible (less than 10%)
+  uint32 slept = sleeperState->rtcMem.driftSlept;
+  sint32 delta = error - sleeperState->rtcMem.driftError;
+  if ((uint32)(delta >= 0? delta : -delta) < slept/10)
+  {
+    DriftSampleT* sample = &sleeperState->rtcMem.driftSamples[sleeperState->rtcMem.driftSampleNext];
+    sample->slept = slept/1000 < 0xFFFF? slept/1000 : 0xFFFF;
+    sample->scale = ((uint64)sleeperState->rtcMem.downtimeScale*slept)/(slept + delta);
+    sleeperState->rtcMem.driftSampleNext = (sleeperState->rtcMem.driftSampleNext + 1)%DRIFT_SAMPLES;
+    if (sleeperState->rtcMem.driftSampleCount < DRIFT_SAMPLES)
+    {
+      sleeperState->rtcMem.driftSampleCount++;
+    }
+    LOG_INFO("drift: %ld ms in %lu s -> scale %u\r\n", delta, slept/1000, sample->scale);
+
+    // fit downtime scale
+    if (sleeperState->rtcMem.autoTimeScale && sleeperState->rtcMem.driftSampleCount >= DRIFT_MIN_FIT)
+    {
+      uint16 scale = getMeanScale(sleeperState);
+      if (scale >= MIN_DEEP_SLEEP_SCALE && scale <= MAX_DEEP_SLEEP_SCALE)
+      {
+        sleeperState->rtcMem.downtimeScale = scale;
+      }
+    }
+  }
+  else
+  {
+    LOG_INFO("drift: ignoring implausible error %ld ms in %lu s\r\n", delta, slept/1000);
+  }
+
+  // start next sample
+  sleeperState->rtcMem.driftError = error;
+  sleeperState->rtcMem.driftSlept = 0;
+}
+
+/**
+ * accumulate requested sleep duration [ms] and error of estimated sleep duration [ms] measured with RTC counter
+ */
+void ICACHE_FLASH_ATTR driftAddMeasuredSleep(SleeperStateT* sleeperState, uint32 slept, sint32 error)
+{
+  if (sleeperState->rtcMem.driftBaseline && !sleeperState->rtcMem.driftMeasured)
+  {
+    // sample was started by server observation
+    driftInvalidate(sleeperState);
+  }
+  if (!sleeperState->rtcMem.driftBaseline)
+  {
+    // start new sample
+    sleeperState->rtcMem.driftBaseline = true;
+    sleeperState->rtcMem.driftMeasured = true;
+  }
+
+  sleeperState->rtcMem.driftSlept += slept;
+  sleeperState->rtcMem.driftError += error;
+  if (sleeperState->rtcMem.driftSlept >= DRIFT_MIN_SLEEP)
+  {
+    // accumulated error is relative to start of sample
+    error = sleeperState->rtcMem.driftError;
+    sleeperState->rtcMem.driftError = 0;
+    addSample(sleeperState, error);
+    sleeperState->rtcMem.driftError = 0;
+  }
+}
+
+/**
+ * process clock error observed at server reply [ms], positive if clock is late
+ */
+void ICACHE_FLASH_ATTR driftObserve(SleeperStateT* sleeperState, sint32 error)
+{
+  if (sleeperState->rtcMem.driftMeasured)
+  {
+    // clock error is not caused by deep sleep timer
+    return;
+  }
+
+  if (!sleeperState->rtcMem.driftBaseline)
+  {
+    // start new sample
+    sleeperState->rtcMem.driftBaseline = true;
+    sleeperState->rtcMem.driftError    = error;
+    sleeperState->rtcMem.driftSlept    = 0;
+  }
+  else if (sleeperState->rtcMem.driftSlept >= DRIFT_MIN_SLEEP)
+  {
+    addSample(sleeperState, error);
+  }
+}
+
+/**
+ * clock was corrected by error [ms], shift reference of current sample
+ */
+void ICACHE_FLASH_ATTR driftSynchronized(SleeperStateT* sleeperState, sint32 error)
+{
+  sleeperState->rtcMem.driftError -= error;
+}
+
+/**
+ * get sleep weighted standard deviation of drift samples (10000 = 1.0) as confidence of downtime scale
+ *
+ * @return -1 if not enough samples are available
+ */
+sint16 ICACHE_FLASH_ATTR driftGetDeviation(SleeperStateT* sleeperState)
+{
+  if (sleeperState->rtcMem.driftSampleCount < 2)
+  {
+    return -1;
+  }
+
+  uint16 mean = getMeanScale(sleeperState);
+  uint32 weights = 0;
+  uint64 sum = 0;
+  for (uint8 i=0; i<sleeperState->rtcMem.driftSampleCount; i++)
+  {
+    DriftSampleT* sample = &sleeperState->rtcMem.driftSamples[i];
+    sint32 diff = sample->scale - mean;
+    weights += sample->slept;
+    sum += (uint64)sample->slept*(uint32)(diff*diff);
+  }
+  uint32 deviation = isqrt(sum/weights);
+  return deviation < 0x7FFF? deviation : 0x7FFF;
+}
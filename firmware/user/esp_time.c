@@ -1,6 +1,6 @@
 /*****************************************************************************
  *
- * Copyright (c) 2015-2016 jnsbyr
+ * Copyright (c) 2015-2026 jnsbyr
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -29,6 +29,14 @@
  * other special exception of the Gregorian calendar are not taken into
  * account, so accuracy is limited in this respect.
  *
+ * The calendar conversion uses integer math only (days from civil and
+ * civil from days algorithms by Howard Hinnant) without SDK functions and
+ * supports 64 bit milliseconds beyond the year 2106.
+ *
+ * Local time is supported with a rule based time zone description that
+ * covers the POSIX TZ format subset with Mm.w.d transition rules as used by
+ * all common time zones with daylight saving time.
+ *
  *****************************************************************************/
 
 #include "esp_time.h"
@@ -36,28 +44,61 @@
 #include <osapi.h>
 #include <c_types.h>
 
-struct tm
+#define MILLIS_PER_DAY    (1000ULL*SECONDS_PER_DAY)
+#define MILLIS_PER_MINUTE 60000LL
+
+#define DAYS_PER_ERA    146097 // days per 400 years of the Gregorian calendar
+#define DAYS_0000_1970  719468 // days from 01.03.0000 to 01.01.1970
+
+LOCAL const uint8 daysPerMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+LOCAL uint8 ICACHE_FLASH_ATTR isLeapYear(uint32 year)
+{
+  return (year%4 == 0 && year%100 != 0) || year%400 == 0;
+}
+
+/*
+ * days since 01.01.1970 for Gregorian calendar date (year >= 1970, month 1-12, day 1-31)
+ * using a year that starts in March so that the leap day is the last day of the year
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR daysFromCivil(uint32 year, uint32 month, uint32 day)
+{
+  year -= month <= 2;
+  uint32 era = year/400;
+  uint32 yoe = year - 400*era;                                           // year of era [0, 399]
+  uint32 doy = (153*(month > 2? month - 3 : month + 9) + 2)/5 + day - 1; // day of year [0, 365]
+  uint32 doe = 365*yoe + yoe/4 - yoe/100 + doy;                          // day of era [0, 146096]
+  return DAYS_PER_ERA*era + doe - DAYS_0000_1970;
+}
+
+/*
+ * Gregorian calendar date for days since 01.01.1970 (sets tm_mday, tm_mon, tm_year, tm_wday and tm_yday)
+ */
+LOCAL void ICACHE_FLASH_ATTR civilFromDays(uint32 days, struct ets_tm* tms)
 {
-  uint32 tm_sec;   /* seconds: 0-59 */
-  uint32 tm_min;   /* minutes: 0-59 */
-  uint32 tm_hour;  /* hours since midnight: 0-23 */
-  uint32 tm_mday;  /* day of the month: 1-31 */
-  uint32 tm_mon;   /* months since January: 0-11 */
-  uint32 tm_year;  /* years since 1900 */
-  uint32 tm_wday;  /* days since Sunday (0-6) */
-  uint32 tm_yday;  /* days since January 1: 0-365 */
-  uint32 tm_isdst; /* +1 DST, 0 no DST, -1 unknown */
-};
-
-// enable undocumented SDK function (works as gmtime if timezone is not set with sntp_set_timezone)
-extern struct tm* sntp_localtime(const uint32*);
+  uint32 z   = days + DAYS_0000_1970;
+  uint32 era = z/DAYS_PER_ERA;
+  uint32 doe = z - DAYS_PER_ERA*era;                          // day of era [0, 146096]
+  uint32 yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365; // year of era [0, 399]
+  uint32 doy = doe - (365*yoe + yoe/4 - yoe/100);             // day of year starting in March [0, 365]
+  uint32 mp  = (5*doy + 2)/153;                               // month starting in March [0, 11]
+  uint32 year = 400*era + yoe + (mp >= 10);
+  tms->tm_mday = doy - (153*mp + 2)/5 + 1;
+  tms->tm_mon  = mp < 10? mp + 2 : mp - 10;
+  tms->tm_year = year - 1900;
+  tms->tm_yday = doy >= 306? doy - 306 : doy + 59 + isLeapYear(year);
+  tms->tm_wday = (days + 4)%7; // 01.01.1970 was a Thursday
+}
 
 /*
  * mktime implementation with milliseconds support
  */
 uint64 ICACHE_FLASH_ATTR esp_mktime(struct ets_tm* tms)
 {
-  return system_mktime(1900 + tms->tm_year, 1 + tms->tm_mon, tms->tm_mday, tms->tm_hour, tms->tm_min, tms->tm_sec)*1000ULL + tms->tm_msec;
+  uint32 year  = 1900 + tms->tm_year + tms->tm_mon/12;
+  uint32 month = 1 + tms->tm_mon%12;
+  uint64 days  = daysFromCivil(year, month, tms->tm_mday);
+  return days*MILLIS_PER_DAY + 1000ULL*(SECONDS_PER_HOUR*tms->tm_hour + 60*tms->tm_min + tms->tm_sec) + tms->tm_msec;
 }
 
 /*
@@ -65,18 +106,17 @@ uint64 ICACHE_FLASH_ATTR esp_mktime(struct ets_tm* tms)
  */
 void ICACHE_FLASH_ATTR esp_gmtime(uint64* t, struct ets_tm* tms)
 {
-  uint32 secs = *t/1000ULL;  // [ms] -> [s]
-  struct tm* tmp = sntp_localtime(&secs);
-  tms->tm_msec  = *t%1000ULL;
-  tms->tm_sec   = tmp->tm_sec;
-  tms->tm_min   = tmp->tm_min;
-  tms->tm_hour  = tmp->tm_hour;
-  tms->tm_mday  = tmp->tm_mday;
-  tms->tm_mon   = tmp->tm_mon;
-  tms->tm_year  = tmp->tm_year;
-  tms->tm_wday  = tmp->tm_wday;
-  tms->tm_yday  = tmp->tm_yday;
-  tms->tm_isdst = tmp->tm_isdst;
+  // single 64 bit division, remainder fits into 32 bits
+  uint32 days   = *t/MILLIS_PER_DAY;
+  uint32 millis = *t - days*MILLIS_PER_DAY;
+  uint32 secs   = millis/1000;
+  tms->tm_msec  = millis - 1000*secs;
+  tms->tm_hour  = secs/SECONDS_PER_HOUR;
+  secs         -= SECONDS_PER_HOUR*tms->tm_hour;
+  tms->tm_min   = secs/60;
+  tms->tm_sec   = secs - 60*tms->tm_min;
+  tms->tm_isdst = 0;
+  civilFromDays(days, tms);
 }
 
 /**
@@ -133,3 +173,254 @@ const char* ICACHE_FLASH_ATTR esp_strptime(const char *s, const char *format, st
     return NULL;
   }
 }
+
+/**
+ * get start of day of DST transition rule Mm.w.d in milliseconds since 1970
+ *
+ * @param year years since 1900
+ */
+LOCAL uint64 ICACHE_FLASH_ATTR getTransitionDay(uint32 year, uint8 month, uint8 week, uint8 wday)
+{
+  struct ets_tm rule;
+  os_memset(&rule, 0, sizeof(rule));
+  rule.tm_year = year;
+  rule.tm_mon  = month - 1;
+  rule.tm_mday = 1;
+  uint64 first = esp_mktime(&rule);
+
+  // 1st matching weekday of month (01.01.1970 was a Thursday)
+  uint32 firstWday = (first/MILLIS_PER_DAY + 4)%7;
+  uint32 mday = 1 + (7 + wday - firstWday)%7 + 7*(week - 1);
+
+  // week 5 means last matching weekday of month
+  uint32 lastMday = daysPerMonth[month - 1] + (month == 2 && isLeapYear(1900 + year));
+  while (mday > lastMday)
+  {
+    mday -= 7;
+  }
+
+  return first + (mday - 1)*MILLIS_PER_DAY;
+}
+
+/**
+ * check if DST is active at UTC time t [ms]
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR isDST(sint64 t, const struct ets_tz* tz)
+{
+  if (tz->dstOffset == 0 || tz->dstStartMonth == 0 || tz->dstEndMonth == 0)
+  {
+    // no DST
+    return false;
+  }
+
+  // year of local standard time
+  sint64 local = t + MILLIS_PER_MINUTE*tz->offset;
+  if (local < 0)
+  {
+    return false;
+  }
+  struct ets_tm ltm;
+  uint64 l = local;
+  esp_gmtime(&l, &ltm);
+
+  // DST start is given in local standard time, DST end is given in local DST time
+  sint64 start = getTransitionDay(ltm.tm_year, tz->dstStartMonth, tz->dstStartWeek, tz->dstStartWday) + MILLIS_PER_MINUTE*(tz->dstStartTime - tz->offset);
+  sint64 end   = getTransitionDay(ltm.tm_year, tz->dstEndMonth, tz->dstEndWeek, tz->dstEndWday) + MILLIS_PER_MINUTE*(tz->dstEndTime - tz->offset - tz->dstOffset);
+  if (start < end)
+  {
+    // northern hemisphere
+    return t >= start && t < end;
+  }
+  else
+  {
+    // southern hemisphere
+    return t < end || t >= start;
+  }
+}
+
+/*
+ * UTC offset of time zone including DST
+ */
+sint32 ICACHE_FLASH_ATTR esp_tzoffset(uint64* t, const struct ets_tz* tz)
+{
+  return tz->offset + (isDST(*t, tz)? tz->dstOffset : 0);
+}
+
+/*
+ * localtime implementation with milliseconds support and explicit time zone
+ */
+void ICACHE_FLASH_ATTR esp_localtime(uint64* t, const struct ets_tz* tz, struct ets_tm* tms)
+{
+  sint32 offset = esp_tzoffset(t, tz);
+  sint64 local = (sint64)*t + MILLIS_PER_MINUTE*offset;
+  uint64 l = local > 0? local : 0;
+  esp_gmtime(&l, tms);
+  tms->tm_isdst = offset != tz->offset;
+}
+
+/*
+ * mktime implementation for local time with milliseconds support and explicit time zone
+ */
+uint64 ICACHE_FLASH_ATTR esp_mklocaltime(struct ets_tm* tms, const struct ets_tz* tz)
+{
+  sint64 t = (sint64)esp_mktime(tms) - MILLIS_PER_MINUTE*tz->offset;
+  if (isDST(t - MILLIS_PER_MINUTE*tz->dstOffset, tz))
+  {
+    t -= MILLIS_PER_MINUTE*tz->dstOffset;
+  }
+
+  return t > 0? t : 0;
+}
+
+/**
+ * parse TZ name, either alphabetic or quoted with angle brackets
+ */
+LOCAL const char* ICACHE_FLASH_ATTR parseTZName(const char* s)
+{
+  const char* p = s;
+  if (*p == '<')
+  {
+    while (*p && *p != '>')
+    {
+      p++;
+    }
+    return *p == '>' && p - s >= 4? p + 1 : NULL;
+  }
+  while ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))
+  {
+    p++;
+  }
+  return p - s >= 3? p : NULL;
+}
+
+/**
+ * parse TZ time [+|-]hh[:mm[:ss]] into minutes (seconds are ignored)
+ */
+LOCAL const char* ICACHE_FLASH_ATTR parseTZTime(const char* s, sint32* minutes)
+{
+  sint32 sign = 1;
+  if (*s == '+' || *s == '-')
+  {
+    sign = *s == '-'? -1 : 1;
+    s++;
+  }
+  if (*s < '0' || *s > '9')
+  {
+    return NULL;
+  }
+  sint32 hours = 0;
+  for (uint8 i=0; i<3 && *s >= '0' && *s <= '9'; i++, s++)
+  {
+    hours = 10*hours + (*s - '0');
+  }
+  sint32 mins = 0;
+  if (*s == ':')
+  {
+    if (s[1] < '0' || s[1] > '5' || s[2] < '0' || s[2] > '9')
+    {
+      return NULL;
+    }
+    mins = 10*(s[1]-'0') + (s[2]-'0');
+    s += 3;
+    if (*s == ':')
+    {
+      if (s[1] < '0' || s[1] > '5' || s[2] < '0' || s[2] > '9')
+      {
+        return NULL;
+      }
+      s += 3;
+    }
+  }
+  *minutes = sign*(60*hours + mins);
+
+  return s;
+}
+
+/**
+ * parse TZ transition rule ,Mm.w.d[/time]
+ */
+LOCAL const char* ICACHE_FLASH_ATTR parseTZRule(const char* s, uint8* month, uint8* week, uint8* wday, uint16* time)
+{
+  if (s[0] != ',' || s[1] != 'M' || s[2] < '0' || s[2] > '9')
+  {
+    return NULL;
+  }
+  s += 2;
+  uint8 m = *s++ - '0';
+  if (*s >= '0' && *s <= '9')
+  {
+    m = 10*m + (*s++ - '0');
+  }
+  if (m < 1 || m > 12 || s[0] != '.' || s[1] < '1' || s[1] > '5' || s[2] != '.' || s[3] < '0' || s[3] > '6')
+  {
+    return NULL;
+  }
+  *month = m;
+  *week  = s[1] - '0';
+  *wday  = s[3] - '0';
+  s += 4;
+
+  sint32 minutes = 120; // default 02:00
+  if (*s == '/')
+  {
+    s = parseTZTime(s + 1, &minutes);
+    if (!s || minutes < 0 || minutes > 7*MINUTES_PER_DAY)
+    {
+      return NULL;
+    }
+  }
+  *time = minutes;
+
+  return s;
+}
+
+/**
+ * tzset subset implementation with explicit time zone
+ *
+ * @param s must comply to format std offset [dst [offset],Mm.w.d[/time],Mm.w.d[/time]]
+ * @param tz return value, only modified if s is valid
+ * @return pointer to first unprocessed input character or NULL on error
+ */
+const char* ICACHE_FLASH_ATTR esp_tzset(const char *s, struct ets_tz* tz)
+{
+  struct ets_tz parsed;
+  os_memset(&parsed, 0, sizeof(parsed));
+
+  // standard time name and offset (POSIX offsets are positive west of Greenwich)
+  sint32 stdMinutes;
+  s = parseTZName(s);
+  if (!s || !(s = parseTZTime(s, &stdMinutes)) || stdMinutes < -MINUTES_PER_DAY || stdMinutes > MINUTES_PER_DAY)
+  {
+    return NULL;
+  }
+  parsed.offset = -stdMinutes;
+
+  if (*s && *s != ',')
+  {
+    // DST name, optional offset (default 1 hour ahead of standard time) and mandatory transition rules
+    sint32 dstMinutes = stdMinutes - 60;
+    s = parseTZName(s);
+    if (s && *s != ',')
+    {
+      s = parseTZTime(s, &dstMinutes);
+    }
+    if (!s || dstMinutes < -MINUTES_PER_DAY || dstMinutes > MINUTES_PER_DAY || dstMinutes == stdMinutes)
+    {
+      return NULL;
+    }
+    parsed.dstOffset = stdMinutes - dstMinutes;
+    s = parseTZRule(s, &parsed.dstStartMonth, &parsed.dstStartWeek, &parsed.dstStartWday, &parsed.dstStartTime);
+    if (s)
+    {
+      s = parseTZRule(s, &parsed.dstEndMonth, &parsed.dstEndWeek, &parsed.dstEndWday, &parsed.dstEndTime);
+    }
+    if (!s)
+    {
+      return NULL;
+    }
+  }
+
+  *tz = parsed;
+
+  return s;
+}
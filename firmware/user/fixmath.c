@@ -0,0 +1,124 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    fixmath.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * The lx106 has no FPU, so log() of the C library is emulated in software
+ * with data dependent run time. The logarithm is calculated in Q16.16 fixed point from
+ * the position of the most significant bit and a 32 segment table of
+ * log2(1 + i/32) with linear interpolation.
+ *
+ * The interpolation error of fixLog2 is bounded by (1/32)^2/8/ln(2) = 1.8e-4
+ * (12 LSB) plus rounding, so the error of fixLnRatio, the difference of two
+ * logarithms scaled by ln(2), stays below about 2.7e-4 (18 LSB).
+ *
+ * The exponential function is calculated by range reduction to a power of 2
+ * and a 5 term Taylor series, the truncation error of fixExpNeg is bounded by
+ * ln(2)^6/6! = 1.5e-4 (10 LSB) plus rounding.
+ *
+ *****************************************************************************/
+
+#include "fixmath.h"
+
+#define LN2 45426UL // ln(2) in Q16.16
+
+LOCAL const uint32 log2Table[33] =
+{
+      0,  2909,  5732,  8473, 11136, 13727, 16248, 18704,
+  21098, 23433, 25711, 27936, 30109, 32234, 34312, 36346,
+  38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207,
+  52911, 54584, 56229, 57845, 59434, 60997, 62534, 64047,
+  65536
+};
+
+/**
+ * binary logarithm
+ *
+ * @param x must be > 0
+ * @return log2(x) in Q16.16
+ */
+uint32 ICACHE_FLASH_ATTR fixLog2(uint32 x)
+{
+  if (!x)
+  {
+    return 0;
+  }
+
+  // integer part: position of most significant bit
+  uint32 exponent = 31 - __builtin_clz(x);
+
+  // normalize mantissa to [2^31, 2^32)
+  uint32 mantissa = x << (31 - exponent);
+
+  // fractional part: table segment (5 bits) and linear interpolation (16 bits)
+  uint32 index = (mantissa >> 26) & 0x1F;
+  uint32 fraction = (mantissa >> 10) & 0xFFFF;
+  uint32 lower = log2Table[index];
+  uint32 upper = log2Table[index + 1];
+
+  return (exponent << 16) + lower + (((upper - lower)*fraction + 0x8000) >> 16);
+}
+
+/**
+ * natural logarithm of a ratio
+ *
+ * @param num must be >= den
+ * @param den must be > 0
+ * @return ln(num/den) in Q16.16, 0 if num <= den
+ */
+uint32 ICACHE_FLASH_ATTR fixLnRatio(uint32 num, uint32 den)
+{
+  if (!den || num <= den)
+  {
+    return 0;
+  }
+
+  uint32 log2Ratio = fixLog2(num) - fixLog2(den);
+  return ((uint64)log2Ratio*LN2 + 0x8000) >> 16;
+}
+
+/**
+ * exponential function of a negative argument
+ *
+ * @param x Q16.16
+ * @return e^-x in Q16.16
+ */
+uint32 ICACHE_FLASH_ATTR fixExpNeg(uint32 x)
+{
+  // range reduction: e^-x = 2^-n * e^-r with 0 <= r < ln(2)
+  uint32 n = x/LN2;
+  if (n > 16)
+  {
+    return 0;
+  }
+  uint32 r = x - n*LN2;
+
+  // e^-r = 1 - r*(1 - r/2*(1 - r/3*(1 - r/4*(1 - r/5))))
+  uint32 y = FIX_ONE - r/5;
+  y = FIX_ONE - (((uint64)r*y >> 16) + 2)/4;
+  y = FIX_ONE - (((uint64)r*y >> 16) + 1)/3;
+  y = FIX_ONE - (((uint64)r*y >> 16) + 1)/2;
+  y = FIX_ONE - ((uint64)r*y >> 16);
+
+  return n? (y + (1UL << (n - 1))) >> n : y;
+}
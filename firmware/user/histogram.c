@@ -0,0 +1,117 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    histogram.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * Compact latency histograms for RTC memory with one byte per bucket. The
+ * buckets are log-scale: bucket 0 counts values below the unit, bucket i
+ * counts values below unit*2^i and the last bucket is unbounded. When a
+ * bucket is full all buckets are halved, so older samples fade out and the
+ * distribution follows changes of the network.
+ *
+ *****************************************************************************/
+
+#include "histogram.h"
+
+#include <osapi.h>
+
+/**
+ * clear all buckets
+ */
+void ICACHE_FLASH_ATTR histogramReset(HistogramT* histogram)
+{
+  os_memset(histogram, 0, sizeof(HistogramT));
+}
+
+/**
+ * add sample
+ *
+ * @param unit upper bound of first bucket
+ * @param value sample in same unit as upper bound
+ */
+void ICACHE_FLASH_ATTR histogramAdd(HistogramT* histogram, uint16 unit, uint32 value)
+{
+  uint8 bucket = 0;
+  for (uint32 bound = unit; value >= bound && bucket < HISTOGRAM_BUCKETS - 1; bound <<= 1)
+  {
+    bucket++;
+  }
+
+  if (histogram->count[bucket] == 0xFF)
+  {
+    // age samples
+    for (uint8 i=0; i<HISTOGRAM_BUCKETS; i++)
+    {
+      histogram->count[i] >>= 1;
+    }
+  }
+  histogram->count[bucket]++;
+}
+
+/**
+ * get upper bound of bucket containing percentile
+ *
+ * @return upper bound, 0 if not enough samples, 0xFFFFFFFF if in last bucket
+ */
+uint32 ICACHE_FLASH_ATTR histogramPercentile(const HistogramT* histogram, uint16 unit, uint8 percentile)
+{
+  uint16 total = 0;
+  for (uint8 i=0; i<HISTOGRAM_BUCKETS; i++)
+  {
+    total += histogram->count[i];
+  }
+  if (total < HISTOGRAM_MIN_SAMPLES)
+  {
+    return 0;
+  }
+
+  uint16 rank = ((uint32)total*percentile + 99)/100;
+  uint16 sum = 0;
+  for (uint8 i=0; i<HISTOGRAM_BUCKETS - 1; i++)
+  {
+    sum += histogram->count[i];
+    if (sum >= rank)
+    {
+      return (uint32)unit << i;
+    }
+  }
+
+  return 0xFFFFFFFF;
+}
+
+/**
+ * format buckets as JSON array
+ *
+ * @return number of characters written (max. 2 + 4*HISTOGRAM_BUCKETS)
+ */
+uint16 ICACHE_FLASH_ATTR histogramFormat(const HistogramT* histogram, char* buffer)
+{
+  char* p = buffer;
+  for (uint8 i=0; i<HISTOGRAM_BUCKETS; i++)
+  {
+    p += os_sprintf(p, i? ",%u" : "[%u", histogram->count[i]);
+  }
+  p += os_sprintf(p, "]");
+
+  return p - buffer;
+}
@@ -0,0 +1,167 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    log.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * Binary log ring (LOG_RING). Instead of formatting a message and shifting
+ * it out of the UART, the address of the format string, the uptime and the
+ * raw arguments are stored in a ring in RAM. The format string is only
+ * scanned for the argument types: 64 bit arguments take two words and
+ * strings are reduced to their first 4 characters. The oldest entries are
+ * overwritten when the ring is full.
+ *
+ * The ring is lost in deep sleep. On request of the server it is appended
+ * to the status message of the same wake. The format IDs are resolved with
+ * the symbol table of the firmware image matching the reported version.
+ *
+ *****************************************************************************/
+
+#include "log.h"
+
+#if LOG_RING
+
+#include <osapi.h>
+#include <stdarg.h>
+#include <user_interface.h>
+
+typedef struct
+{
+  const char* format;        // format ID
+  uint16 time;               // [ms] uptime
+  uint8  argc;               // number of argument words
+  uint32 args[LOG_MAX_ARGS];
+} LogEntryT;
+
+LOCAL LogEntryT ring[LOG_RING_SIZE];
+LOCAL uint8  head;           // index of next entry
+LOCAL uint8  count;          // number of entries in ring
+LOCAL uint16 dropped;        // number of overwritten entries
+
+/**
+ * store format ID and arguments in log ring
+ */
+void ICACHE_FLASH_ATTR logRecord(const char* format, ...)
+{
+  LogEntryT* entry = &ring[head];
+  entry->format = format;
+  entry->time = system_get_time()/1000;
+  entry->argc = 0;
+
+  va_list args;
+  va_start(args, format);
+  for (const char* p = format; *p; p++)
+  {
+    if (*p != '%')
+    {
+      continue;
+    }
+
+    // skip flags, width and precision, count length modifiers
+    uint8 longs = 0;
+    p++;
+    while ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '.' || *p == 'l')
+    {
+      longs += *p++ == 'l';
+    }
+    if (!*p)
+    {
+      break;
+    }
+    if (*p == '%')
+    {
+      continue;
+    }
+
+    uint32 value;
+    if (*p == 's')
+    {
+      // first 4 characters of string
+      const char* s = va_arg(args, const char*);
+      value = 0;
+      for (uint8 i=0; i<4 && s[i]; i++)
+      {
+        value |= (uint32)(uint8)s[i] << 8*i;
+      }
+    }
+    else if (longs > 1)
+    {
+      uint64 v = va_arg(args, uint64);
+      if (entry->argc < LOG_MAX_ARGS)
+      {
+        entry->args[entry->argc++] = v;
+      }
+      value = v >> 32;
+    }
+    else
+    {
+      value = va_arg(args, uint32);
+    }
+    if (entry->argc < LOG_MAX_ARGS)
+    {
+      entry->args[entry->argc++] = value;
+    }
+  }
+  va_end(args);
+
+  head = (head + 1)%LOG_RING_SIZE;
+  if (count < LOG_RING_SIZE)
+  {
+    count++;
+  }
+  else
+  {
+    dropped++;
+  }
+}
+
+/**
+ * format log ring as JSON property, oldest entry first, entries that do not fit are dropped
+ *
+ * @return number of characters written
+ */
+uint16 ICACHE_FLASH_ATTR logFormat(char* buffer, uint16 size)
+{
+  uint16 length = os_sprintf(buffer, ", \"log\":{\"entries\":[");
+  uint16 written = 0;
+  for (uint8 i=0; i<count; i++)
+  {
+    // one entry requires at most 18 characters per word
+    if (length + 18*(3 + LOG_MAX_ARGS) + 40 > size)
+    {
+      break;
+    }
+    const LogEntryT* entry = &ring[(head + LOG_RING_SIZE - count + i)%LOG_RING_SIZE];
+    length += os_sprintf(buffer + length, "%s[%lu,%u", i? "," : "", (uint32)entry->format, entry->time);
+    for (uint8 j=0; j<entry->argc; j++)
+    {
+      length += os_sprintf(buffer + length, ",%lu", entry->args[j]);
+    }
+    length += os_sprintf(buffer + length, "]");
+    written++;
+  }
+  length += os_sprintf(buffer + length, "], \"dropped\":%u}", dropped + count - written);
+
+  return length;
+}
+
+#endif /* LOG_RING */
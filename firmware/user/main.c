@@ -1,6 +1,6 @@
 /*****************************************************************************
  *
- * Copyright (c) 2015-2019 jnsbyr
+ * Copyright (c) 2015-2026 jnsbyr
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -44,9 +44,7 @@
  *
  * @todo improve estimate of totalOpenDuration in manual override mode
  * @todo config of access point parameters in AP mode on initial startup (via mini-webserver?) -> flash
- * @todo UDP service advertisement broadcast to receive config for server/port
  * @todo reset flash config (via GPIO? e.g. very long press?)
- * @todo make UART debug output optional
  * @todo support modification of runtime while valve is open
  *
  *****************************************************************************/
@@ -60,12 +58,20 @@
 #include <version.h>
 #include <json/jsonparse.h>
 #include "esp_time.h"
-#include "adc.h"
+#include "battery.h"
+#include "discovery.h"
+#include "drift.h"
+#include "histogram.h"
+#include "trace.h"
 #include "valve.h"
 #include "uplink.h"
+#include "scenario.h"
 
 #define VERSION SLEEPER_VERSION
 
+LOCAL const char* const timingNames[TIMING_HISTOGRAMS] = {"association", "connect", "reply", "parse"};
+LOCAL const uint16 timingUnits[TIMING_HISTOGRAMS] = {WLAN_HISTOGRAM_UNIT, CONNECT_HISTOGRAM_UNIT, REPLY_HISTOGRAM_UNIT, PARSE_HISTOGRAM_UNIT};
+
 // manual start/stop GPIO input
 #define USER_WAKEUP_GPIO_MUX PERIPHS_IO_MUX_MTMS_U
 #define USER_WAKEUP_GPIO_FUNC FUNC_GPIO14
@@ -84,17 +90,269 @@ LOCAL SleeperStateT state;
 LOCAL struct ets_tm tms;
 LOCAL struct ets_tm nowTMS;
 LOCAL uint8 uplinkSocketConnected;
+LOCAL uint8 discovering;
+LOCAL uint8 island;         // bool, RF is disabled in current wake cycle
+LOCAL uint8 uplinkReplied;  // bool, reply received from server in current wake cycle
 LOCAL uint8 statusSent;
 LOCAL uint8 readyForShutdown;
-LOCAL char txMessage[288];
+LOCAL uint8 valveControlled;
+LOCAL char txMessage[2048];
 LOCAL uint64 nextEventTime;
+LOCAL uint32 awakeBudget; // [ms] uptime until uplink is abandoned
+LOCAL uint32 wlanTimeout; // [ms] uptime until WLAN connect is abandoned
+LOCAL uint32 requestTime; // [ms] uptime when TCP request was started
+LOCAL uint8 timingSent;   // bool, timing histograms were sent with request
+#if LOG_RING
+LOCAL uint8 logRequested; // bool, server requested log ring with status message
+#endif
+#if SCENARIO_BENCHMARK
+LOCAL uint64 virtualTime; // [ms] virtual time at start of system timer, 0 = real time
+#endif
+
+/**
+ * time between last shutdown and start of system timer in milliseconds,
+ * measured with RTC counter or estimated from requested downtime
+ */
+LOCAL uint32 getDowntime()
+{
+  return state.measuredDowntime? state.measuredDowntime : state.rtcMem.lastDowntime + state.rtcMem.boottime;
+}
 
 /**
  * estimate current time in milliseconds
  */
 uint64 getTime()
 {
-  return state.rtcMem.lastShutdownTime + state.rtcMem.lastDowntime + state.rtcMem.boottime + system_get_time()/1000;
+#if SCENARIO_BENCHMARK
+  if (virtualTime)
+  {
+    return virtualTime + system_get_time()/1000;
+  }
+#endif
+  return state.rtcMem.lastShutdownTime + getDowntime() + system_get_time()/1000;
+}
+
+#if SCENARIO_BENCHMARK
+/**
+ * set current time of virtual clock in milliseconds, 0 = real time
+ */
+void ICACHE_FLASH_ATTR setTime(uint64 now)
+{
+  virtualTime = now? now - system_get_time()/1000 : 0;
+}
+#endif
+
+/**
+ * measure time since last shutdown with RTC counter (RTC counter is only preserved during deep sleep)
+ *
+ * @return milliseconds since last shutdown until start of system timer, 0 if not available
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR measureDowntime()
+{
+  uint32 rtcTime = system_get_rtc_time();
+  uint32 systemTime = system_get_time();
+  uint32 rtcCali = system_rtc_clock_cali_proc();
+  struct rst_info* rstInfo = system_get_rst_info();
+  if (!state.rtcMem.shutdownRtcCali || !rtcCali || rstInfo == NULL || rstInfo->reason != REASON_DEEP_SLEEP_AWAKE)
+  {
+    return 0;
+  }
+
+  // RTC clock periods -> milliseconds (period is Q12 microseconds, average of calibration at shutdown and now)
+  uint32 periods = rtcTime - state.rtcMem.shutdownRtcTime;
+  uint64 elapsed = (((uint64)periods*((state.rtcMem.shutdownRtcCali + rtcCali)/2)) >> 12)/1000; // [ms]
+  uint32 estimated = state.rtcMem.lastDowntime + state.rtcMem.boottime; // [ms]
+  if (elapsed <= systemTime/1000 || elapsed - systemTime/1000 > estimated + estimated/4 + SLEEPER_MIN_DOWNTIME)
+  {
+    // RTC counter was reset or wrapped more than once, deep sleep can only end early
+    LOG_WARNING("WARNING: RTC counter %lu ms implausible, using estimate %lu ms\r\n", (uint32)elapsed, estimated);
+    return 0;
+  }
+
+  return elapsed - systemTime/1000;
+}
+
+/**
+ * record latency between scheduled wakeup and valve control
+ */
+LOCAL void ICACHE_FLASH_ATTR addWakeLatency()
+{
+  if (state.latencyValid)
+  {
+    // time since end of requested downtime (includes boot and deep sleep timer error), early wake counts as 0
+    sint64 latency = (sint64)(getTime() - (state.rtcMem.lastShutdownTime + state.rtcMem.lastDowntime));
+    state.rtcMem.latencySamples[state.rtcMem.latencySampleNext] = latency < 0? 0 : (latency < 0xFFFF? latency : 0xFFFF);
+    state.rtcMem.latencySampleNext = (state.rtcMem.latencySampleNext + 1)%LATENCY_SAMPLES;
+    if (state.rtcMem.latencySampleCount < LATENCY_SAMPLES)
+    {
+      state.rtcMem.latencySampleCount++;
+    }
+  }
+}
+
+/**
+ * get wakeup lead time from configured percentile of latency history
+ *
+ * @return milliseconds
+ */
+LOCAL uint16 ICACHE_FLASH_ATTR getWakeLeadTime()
+{
+  uint8 count = state.rtcMem.latencySampleCount;
+  if (!count)
+  {
+    return SLEEPER_LEADTIME;
+  }
+
+  // sort copy of samples
+  uint16 sorted[LATENCY_SAMPLES];
+  for (uint8 i=0; i<count; i++)
+  {
+    uint16 sample = state.rtcMem.latencySamples[i];
+    uint8 j = i;
+    for (; j>0 && sorted[j-1] > sample; j--)
+    {
+      sorted[j] = sorted[j-1];
+    }
+    sorted[j] = sample;
+  }
+
+  return sorted[(state.rtcMem.leadPercentile*(count - 1) + 50)/100];
+}
+
+/**
+ * get timeout from percentile of observed latency, if previous uplink succeeded
+ *
+ * @return milliseconds, maxTimeout if not enough samples are available
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR getLearnedTimeout(const HistogramT* histogram, uint16 unit, uint32 minTimeout, uint32 maxTimeout)
+{
+  uint32 timeout = state.rtcMem.uplinkFailures? 0 : histogramPercentile(histogram, unit, TIMEOUT_PERCENTILE);
+  if (!timeout || timeout > maxTimeout)
+  {
+    return maxTimeout;
+  }
+
+  return timeout > minTimeout? timeout : minTimeout;
+}
+
+/**
+ * format timing histograms as JSON property if upload interval has elapsed
+ *
+ * @return number of characters written, 0 if upload is not due or buffer is too small
+ */
+LOCAL uint16 ICACHE_FLASH_ATTR timingFormat(char* buffer, uint16 size)
+{
+  if (!state.rtcMem.timingInterval || state.rtcMem.timingElapsed < 3600UL*state.rtcMem.timingInterval
+      || size < 32 + TIMING_HISTOGRAMS*(42 + 4*HISTOGRAM_BUCKETS))
+  {
+    return 0;
+  }
+
+  char* p = buffer;
+  p += os_sprintf(p, ", \"timing\":{\"interval\":%lu", state.rtcMem.timingElapsed);
+  for (uint8 i=0; i<TIMING_HISTOGRAMS; i++)
+  {
+    p += os_sprintf(p, ", \"%s\":{\"unit\":%u, \"count\":", timingNames[i], timingUnits[i]);
+    p += histogramFormat(&state.rtcMem.timingHistograms[i], p);
+    p += os_sprintf(p, "}");
+  }
+  p += os_sprintf(p, "}");
+  timingSent = true;
+
+  return p - buffer;
+}
+
+/**
+ * calculate next downtime after shutdown to wakeup in time for next event
+ *
+ * @param eventTime next valve event time, 0 = none
+ * @return true if RF calibration is needed after wakeup
+ */
+uint8 ICACHE_FLASH_ATTR scheduleDowntime(uint64 eventTime)
+{
+  uint8 needRFCal = true;
+  if (valveIsAnyOpen(&state) && state.rtcMem.downtime > MAX_VALVE_OPEN_DOWNTIME)
+  {
+    // valve is open, limit downtime
+    state.rtcMem.lastDowntime = MAX_VALVE_OPEN_DOWNTIME;
+  }
+  else if (!valveIsAnyOpen(&state))
+  {
+    // valve is closed, stretch downtime if battery is declining
+    state.rtcMem.lastDowntime = batteryGetDowntime(&state);
+  }
+  else
+  {
+    state.rtcMem.lastDowntime = state.rtcMem.downtime;
+  }
+  uint64 nextValeOperationTime = state.rtcMem.lastShutdownTime + state.rtcMem.lastDowntime + getWakeLeadTime();
+  if (eventTime > 0 && nextValeOperationTime > eventTime)
+  {
+    // next valve operation time will be too late for next event: try to cut back on downtime to hit event
+    uint32 cutBackTime = nextValeOperationTime - eventTime;
+    if (state.rtcMem.lastDowntime > (SLEEPER_MIN_DOWNTIME + cutBackTime))
+    {
+      // required cut back leaves at least 1 second downtime: apply cut back
+      state.rtcMem.lastDowntime -= cutBackTime;
+    }
+    else
+    {
+      // required cut back does not leave at least 1 second downtime: limit cut back and accept delay
+      state.rtcMem.lastDowntime = SLEEPER_MIN_DOWNTIME;
+    }
+
+    // skip RF calibration if downtime is less than quarter of regular downtime
+    needRFCal = 4*state.rtcMem.lastDowntime < state.rtcMem.downtime;
+  }
+
+  return needRFCal;
+}
+
+/**
+ * track consecutive uplink failures and back off uplink attempts exponentially
+ * with wake cycles with RF disabled in between (island mode)
+ *
+ * @return true if RF is needed after wakeup
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR scheduleUplink()
+{
+  if (island)
+  {
+    // wake cycle with RF disabled completed
+    if (state.rtcMem.islandWakes)
+    {
+      state.rtcMem.islandWakes--;
+    }
+  }
+  else if (uplinkReplied)
+  {
+    if (state.rtcMem.uplinkFailures)
+    {
+      LOG_INFO("uplink restored after %u failed wake cycles\r\n", state.rtcMem.uplinkFailures);
+    }
+    state.rtcMem.uplinkFailures = 0;
+    state.rtcMem.islandWakes = 0;
+  }
+  else
+  {
+    // uplink failed: 0, 1, 3, 7, ... wake cycles with RF disabled before next attempt
+    if (state.rtcMem.uplinkFailures < 0xFF)
+    {
+      state.rtcMem.uplinkFailures++;
+    }
+    uint8 backoff = state.rtcMem.uplinkFailures - 1;
+    if (backoff > MAX_ISLAND_BACKOFF)
+    {
+      backoff = MAX_ISLAND_BACKOFF;
+    }
+    state.rtcMem.islandWakes = (1 << backoff) - 1;
+    if (state.rtcMem.islandWakes)
+    {
+      LOG_WARNING("WARNING: %u failed uplinks, next %u wake cycles without RF\r\n", state.rtcMem.uplinkFailures, state.rtcMem.islandWakes);
+    }
+  }
+
+  return state.rtcMem.islandWakes == 0;
 }
 
 LOCAL const char* ICACHE_FLASH_ATTR getSleeperModeAsText()
@@ -103,9 +361,9 @@ LOCAL const char* ICACHE_FLASH_ATTR getSleeperModeAsText()
   {
     return "LOW BAT";
   }
-  else if (state.rtcMem.lastValveOperationStatus != VALVE_STATUS_OK)
+  else if (valveGetStatus(&state) != VALVE_STATUS_OK)
   {
-    switch (state.rtcMem.lastValveOperationStatus)
+    switch (valveGetStatus(&state))
     {
       case VALVE_STATUS_BAD_WIRING:        return "BAD VALVE WIRING";
       case VALVE_STATUS_LOW_OPEN_VOLTAGE:  return "LOW OPEN VOLTAGE";
@@ -141,13 +399,16 @@ LOCAL uint8 isUserWakeup()
 
 LOCAL void parseReply(char* reply, uint8* mode, void* start)
 {
-  uint32 rxTime = system_get_time();
-  ets_uart_printf("TCP received reply at %lu ms: %s\r\n", rxTime/1000, reply);
+  uint32 txTime = uplink_getRequestTime(); // [us]
+  uint32 rxTime = uplink_getReplyTime(); // [us]
+  LOG_INFO("TCP received reply at %lu ms: %s\r\n", rxTime/1000, reply);
 
   uint64* startTime = (uint64*)start;
   uint64 serverTime = 0;
+  uint64 serverRequestTime = 0;
   uint16 activityCount = MAX_ACTIVITIES; // prevent clearing of current activities
-  uint8 setTime = state.rtcMem.lastShutdownTime < 946684800000; // invalid if before 01.01.2000;
+  uint8 timeValid = state.rtcMem.lastShutdownTime >= 946684800000; // invalid if before 01.01.2000
+  uint8 setTime = !timeValid;
 
   int type;
   struct jsonparse_state jsonParser;
@@ -169,6 +430,16 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
           serverTime = esp_mktime(&tms);
         }
       }
+      else if (jsonparse_strcmp_value(&jsonParser, "requestTime") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        jsonparse_copy_value(&jsonParser, buffer, sizeof(buffer));
+        if (esp_strptime(buffer, NULL, &tms))
+        {
+          serverRequestTime = esp_mktime(&tms);
+        }
+      }
       else if (jsonparse_strcmp_value(&jsonParser, "timeOffset") == 0)
       {
         jsonparse_next(&jsonParser);
@@ -176,10 +447,75 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
         int timeOffset = jsonparse_get_value_as_int(&jsonParser); // milliseconds
         if (timeOffset >= -500 && timeOffset <= 500)
         {
-          setTime = setTime || timeOffset != state.rtcMem.boottime;
+          if (timeOffset != state.rtcMem.boottime)
+          {
+            // time estimate changes, restart drift sample
+            setTime = true;
+            driftInvalidate(&state);
+          }
           state.rtcMem.boottime = timeOffset; // milliseconds
         }
       }
+      else if (jsonparse_strcmp_value(&jsonParser, "leadPercentile") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int leadPercentile = jsonparse_get_value_as_int(&jsonParser); // percent
+        if (leadPercentile >= 0 && leadPercentile <= 100)
+        {
+          state.rtcMem.leadPercentile = leadPercentile;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "pulseMargin") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int pulseMargin = jsonparse_get_value_as_int(&jsonParser); // milliseconds
+        if (pulseMargin >= 0 && pulseMargin <= VALVE_OPEN_PULSE_DURATION/1000)
+        {
+          state.rtcMem.openPulseMargin = pulseMargin;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "openPulse") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int pulse = jsonparse_get_value_as_int(&jsonParser); // microseconds
+        if (pulse >= MIN_PULSE_DURATION && pulse <= MAX_PULSE_DURATION)
+        {
+          state.rtcMem.pulseProfile.openPulse = (pulse + 50)/100;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "closePulse") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int pulse = jsonparse_get_value_as_int(&jsonParser); // microseconds
+        if (pulse >= MIN_PULSE_DURATION && pulse <= MAX_PULSE_DURATION)
+        {
+          state.rtcMem.pulseProfile.closePulse = (pulse + 50)/100;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "settleTime") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int settleTime = jsonparse_get_value_as_int(&jsonParser); // microseconds
+        if (settleTime >= 0 && settleTime <= MAX_GENERATOR_SETTLE_TIME)
+        {
+          state.rtcMem.pulseProfile.settleTime = (settleTime + 50)/100;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "shortTime") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int shortTime = jsonparse_get_value_as_int(&jsonParser); // microseconds
+        if (shortTime >= 0 && shortTime <= MAX_VALVE_SHORT_TIME)
+        {
+          state.rtcMem.pulseProfile.shortTime = (shortTime + 50)/100;
+        }
+      }
       else if (jsonparse_strcmp_value(&jsonParser, "setTime") == 0)
       {
         jsonparse_next(&jsonParser);
@@ -189,7 +525,7 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
         {
           // sync time if requested or if time is invalid (after cold boot)
           setTime = setTime || set;
-          //ets_uart_printf("JSON setTime %d shutdown time %llu => %u\r\n", set, state.rtcMem.lastShutdownTime, setTime);
+          //LOG_DEBUG("JSON setTime %d shutdown time %llu => %u\r\n", set, state.rtcMem.lastShutdownTime, setTime);
         }
       }
       else if (jsonparse_strcmp_value(&jsonParser, "wakeup") == 0)
@@ -202,6 +538,64 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
           state.rtcMem.downtime = 1000*downtime; // milliseconds
         }
       }
+      else if (jsonparse_strcmp_value(&jsonParser, "stretchDays") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int stretchDays = jsonparse_get_value_as_int(&jsonParser); // days
+        if (stretchDays >= 0 && stretchDays <= 255)
+        {
+          state.rtcMem.stretchDays = stretchDays;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "maxStretch") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int maxStretch = jsonparse_get_value_as_int(&jsonParser); // percent
+        if (maxStretch >= 100 && maxStretch <= 1000)
+        {
+          state.rtcMem.maxStretch = maxStretch;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "wakeBudget") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int wakeBudget = jsonparse_get_value_as_int(&jsonParser); // milliampere seconds
+        if (wakeBudget >= 0 && wakeBudget <= 0xFFFF)
+        {
+          state.rtcMem.wakeBudget = wakeBudget;
+        }
+      }
+      else if (jsonparse_strcmp_value(&jsonParser, "dayBudget") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int dayBudget = jsonparse_get_value_as_int(&jsonParser); // milliampere seconds
+        if (dayBudget >= 0 && dayBudget <= 0xFFFF)
+        {
+          state.rtcMem.dayBudget = dayBudget;
+        }
+      }
+#if LOG_RING
+      else if (jsonparse_strcmp_value(&jsonParser, "log") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        logRequested = jsonparse_get_value_as_int(&jsonParser) != 0;
+      }
+#endif
+      else if (jsonparse_strcmp_value(&jsonParser, "timingInterval") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int timingInterval = jsonparse_get_value_as_int(&jsonParser); // hours
+        if (timingInterval >= 0 && timingInterval <= 255)
+        {
+          state.rtcMem.timingInterval = timingInterval;
+        }
+      }
       else if (jsonparse_strcmp_value(&jsonParser, "mode") == 0)
       {
         jsonparse_next(&jsonParser);
@@ -256,13 +650,28 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
           type = jsonparse_next(&jsonParser);
         }
         int timeScale = negative? -jsonparse_get_value_as_int(&jsonParser) : jsonparse_get_value_as_int(&jsonParser);
-        if (timeScale >= -1000 && timeScale <= 1000)
+        if (timeScale >= -1000 && timeScale <= 1000 && (!state.rtcMem.autoTimeScale || state.rtcMem.driftSampleCount < DRIFT_MIN_FIT))
         {
+          // manual scale, ignored when automatically fitted
           timeScale += 10000; // 10000 = 1.0
-          setTime = setTime || timeScale != state.rtcMem.downtimeScale;
+          if (timeScale != state.rtcMem.downtimeScale)
+          {
+            setTime = true;
+            driftInvalidate(&state);
+          }
           state.rtcMem.downtimeScale = timeScale; //
         }
       }
+      else if (jsonparse_strcmp_value(&jsonParser, "autoTimeScale") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        int autoTimeScale = jsonparse_get_value_as_int(&jsonParser);
+        if (autoTimeScale >= 0 && autoTimeScale <= 1)
+        {
+          state.rtcMem.autoTimeScale = autoTimeScale;
+        }
+      }
       else if (jsonparse_strcmp_value(&jsonParser, "voltageOffset") == 0)
       {
         jsonparse_next(&jsonParser);
@@ -286,6 +695,23 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
           state.rtcMem.lowBattery = state.batteryVoltage < MIN_BATTERY_VOLTAGE;
         }
       }
+      else if (jsonparse_strcmp_value(&jsonParser, "timezone") == 0)
+      {
+        jsonparse_next(&jsonParser);
+        jsonparse_next(&jsonParser);
+        jsonparse_copy_value(&jsonParser, buffer, sizeof(buffer));
+        struct ets_tz timeZone;
+        const char* end = esp_tzset(buffer, &timeZone);
+        if (end && !*end)
+        {
+          // activities are scheduled in local time from now on
+          state.rtcMem.timeZone = timeZone;
+        }
+        else
+        {
+          LOG_INFO("JSON invalid timezone %s\r\n", buffer);
+        }
+      }
       else if (jsonparse_strcmp_value(&jsonParser, "maxResistance") == 0)
       {
         jsonparse_next(&jsonParser);
@@ -314,6 +740,7 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
         {
           // start of activity array
           uint8 activityDay;
+          uint8 activityValve;
           uint16 activityStart;
           uint16 activityDuration;
           do
@@ -322,6 +749,7 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
             {
               // start of new activity object
               activityDay = DAY_INVALID;
+              activityValve = 0;
               activityStart = 0;
               activityDuration = 0;
               do
@@ -367,6 +795,20 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
                       activityDay = DAY_INVALID;
                     }
                   }
+                  else if (jsonparse_strcmp_value(&jsonParser, "valve") == 0)
+                  {
+                    jsonparse_next(&jsonParser);
+                    jsonparse_next(&jsonParser);
+                    int v = jsonparse_get_value_as_int(&jsonParser);
+                    if (v >= 0 && v < MAX_VALVES)
+                    {
+                      activityValve = v;
+                    }
+                    else
+                    {
+                      activityDay = DAY_INVALID;
+                    }
+                  }
                   else if (jsonparse_strcmp_value(&jsonParser, "duration") == 0)
                   {
                     jsonparse_next(&jsonParser);
@@ -383,12 +825,13 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
                   }
                 }
               } while (type != JSON_TYPE_ERROR && type != '}'); // end of object or error
-              ets_uart_printf("JSON activity: day %u minute %u duration %u\r\n", activityDay, activityStart, activityDuration);
+              LOG_DEBUG("JSON activity: day %u minute %u duration %u valve %u\r\n", activityDay, activityStart, activityDuration, activityValve);
               if (type == '}' && activityDay > DAY_INVALID && activityDuration > 0 && activityCount < MAX_ACTIVITIES)
               {
                 // add activity to state
                 ActivityT* activity = &state.rtcMem.activities[activityCount];
                 activity->day       = activityDay;
+                activity->valve     = activityValve;
                 activity->startTime = activityStart;
                 activity->duration  = activityDuration;
                 activityCount++;
@@ -410,28 +853,54 @@ LOCAL void parseReply(char* reply, uint8* mode, void* start)
   // synchronize time if sync is requested
   if (serverTime > 0)
   {
+    // NTP style clock offset and round trip time with t0 = request sent, t1 = request received by server,
+    // t2 = reply sent by server and t3 = reply received (assume t1 = t2 if server does not report request time)
+    sint64 t0 = state.rtcMem.lastShutdownTime + getDowntime() + txTime/1000;
+    sint64 t1 = serverRequestTime > 0 && serverRequestTime <= serverTime? serverRequestTime : serverTime;
+    sint64 t2 = serverTime;
+    sint64 t3 = state.rtcMem.lastShutdownTime + getDowntime() + rxTime/1000;
+    sint64 error = ((t1 - t0) + (t2 - t3))/2;
+    sint64 roundTripTime = (t3 - t0) - (t2 - t1);
+    state.roundTripTime = roundTripTime > 0? (roundTripTime < 0xFFFF? roundTripTime : 0xFFFF) : 0;
+    LOG_INFO("clock offset %ld ms, round trip time %u ms\r\n", (sint32)error, state.roundTripTime);
+
+    // track deep sleep drift
+    if (!timeValid || error <= -0x7FFFFFFFLL || error >= 0x7FFFFFFFLL)
+    {
+      driftInvalidate(&state);
+    }
+    else
+    {
+      driftObserve(&state, error);
+    }
+
     if (setTime) // || state.rtcMem.override || *startTime >= serverTime || (*startTime + 1000UL*state.rtcMem.manualDuration <= serverTime)))
     {
       // fix last shutdown time
       uint64 lastShutdownTime = state.rtcMem.lastShutdownTime;
-      state.rtcMem.lastShutdownTime = serverTime - (rxTime/1000 + state.rtcMem.lastDowntime + state.rtcMem.boottime);
+      state.rtcMem.lastShutdownTime += error;
       state.timeSynchronized = true;
-      //ets_uart_printf("time synchronized\r\n");
+      driftSynchronized(&state, error);
+      //LOG_DEBUG("time synchronized\r\n");
 
-      // fix valve close time
-      if (state.rtcMem.valveCloseTimeEstimated && state.rtcMem.valveCloseTime > 0)
+      // fix valve close times
+      for (uint8 i=0; i<MAX_VALVES; i++)
       {
-        if (state.rtcMem.lastShutdownTime >= lastShutdownTime)
-        {
-          // time advanced
-          state.rtcMem.valveCloseTime += state.rtcMem.lastShutdownTime - lastShutdownTime;
-        }
-        else
+        ValveStateT* valve = &state.rtcMem.valves[i];
+        if (valve->closeTimeEstimated && valve->closeTime > 0)
         {
-          // time reversed
-          state.rtcMem.valveCloseTime -= lastShutdownTime - state.rtcMem.lastShutdownTime;
+          if (state.rtcMem.lastShutdownTime >= lastShutdownTime)
+          {
+            // time advanced
+            valve->closeTime += state.rtcMem.lastShutdownTime - lastShutdownTime;
+          }
+          else
+          {
+            // time reversed
+            valve->closeTime -= lastShutdownTime - state.rtcMem.lastShutdownTime;
+          }
+          valve->closeTimeEstimated = false;
         }
-        state.rtcMem.valveCloseTimeEstimated = false;
       }
 
       // fix override end time
@@ -497,41 +966,64 @@ LOCAL void comTimerCallback(void *arg)
 {
   os_timer_disarm(&comTimer);
 
-  //ets_uart_printf("comTimerCallback uptime %lu ms\r\n", system_get_time()/1000);
+  //LOG_DEBUG("comTimerCallback uptime %lu ms\r\n", system_get_time()/1000);
 
-  // log WLAN station connect status
+  // log WLAN station connect status (not after valve was operated because of WLAN timeout)
   uint8 wlanConnecting = false;
-  if (!uplinkSocketConnected)
+  if (island)
+  {
+    // RF disabled, no uplink
+    comTimeout = 0;
+  }
+  else if (!uplinkSocketConnected && !valveControlled)
   {
     switch (wifi_station_get_connect_status())
     {
       case STATION_GOT_IP:
-        if (state.rtcMem.ipConfig.ip.addr)
+        if (!discovering)
         {
-          state.rssi = wifi_station_get_rssi();
-          ets_uart_printf("IP up after %lu ms, RSSI %d dB\r\n", system_get_time()/1000, state.rssi);
-        }
-        else
-        {
-          // save DHCP IP address (but clear gateway)
-          if (wifi_get_ip_info(STATION_IF, &state.rtcMem.ipConfig))
+          if (state.rtcMem.ipConfig.ip.addr)
           {
-            ets_uart_printf("DHCP got IP " IPSTR " after %lu ms, RSSI %d dB\r\n", IP2STR(&state.rtcMem.ipConfig.ip), system_get_time()/1000, wifi_station_get_rssi());
-            state.rtcMem.ipConfig.gw.addr = 0;
-
-            // disable WLAN DHCP client
-            ets_uart_printf("disabling WLAN station DHCP client\r\n");
-            if (!wifi_station_dhcpc_stop())
-            {
-              ets_uart_printf("ERROR: disabling WLAN station DHCP client failed\r\n");
-            }
+            state.rssi = wifi_station_get_rssi();
+            LOG_INFO("IP up after %lu ms, RSSI %d dB\r\n", system_get_time()/1000, state.rssi);
+            histogramAdd(&state.rtcMem.wlanHistogram, WLAN_HISTOGRAM_UNIT, system_get_time()/1000);
           }
           else
           {
-            ets_uart_printf("ERROR: getting DHCP IP address failed\r\n");
-            state.rtcMem.ipConfig.ip.addr = 0;
+            // save DHCP IP address (but clear gateway)
+            if (wifi_get_ip_info(STATION_IF, &state.rtcMem.ipConfig))
+            {
+              LOG_INFO("DHCP got IP " IPSTR " after %lu ms, RSSI %d dB\r\n", IP2STR(&state.rtcMem.ipConfig.ip), system_get_time()/1000, wifi_station_get_rssi());
+              state.rtcMem.ipConfig.gw.addr = 0;
+
+              // disable WLAN DHCP client
+              LOG_INFO("disabling WLAN station DHCP client\r\n");
+              if (!wifi_station_dhcpc_stop())
+              {
+                LOG_ERROR("ERROR: disabling WLAN station DHCP client failed\r\n");
+              }
+            }
+            else
+            {
+              LOG_ERROR("ERROR: getting DHCP IP address failed\r\n");
+              state.rtcMem.ipConfig.ip.addr = 0;
+            }
           }
+
+          histogramAdd(&state.rtcMem.timingHistograms[TIMING_ASSOCIATION], WLAN_HISTOGRAM_UNIT, system_get_time()/1000);
+
+          // broadcast server discovery if no server is cached
+          discovering = discoveryStart(&state, VERSION);
+        }
+
+        if (discovering && !discoveryCheck(&state))
+        {
+          // passive wait for server discovery reply
+          wlanConnecting = true;
+          comTimeout = (sint32)wlanTimeout - (sint32)(system_get_time()/1000);
+          break;
         }
+        discovering = false;
 
         // convert end timestamp of manual override
         esp_gmtime(&state.rtcMem.overrideEndTime, &tms);
@@ -541,45 +1033,63 @@ LOCAL void comTimerCallback(void *arg)
         esp_gmtime(&state.now, &nowTMS);
 
         // create and send TCP request
-        os_sprintf(txMessage, "{\"name\":\"SleeperRequest\", \"version\":\"%s%c\", \"time\":\"%u-%02u-%02uT%02u:%02u:%02u.%03uZ\", \"overrideEnd\":\"%u-%02u-%02uT%02u:%02u:%02u.%03uZ\", \"mode\":\"%s\", \"state\":\"%s\", \"programId\":%lu, \"opened\":%u, \"totalOpen\":%lu, \"resistance\":%u, \"voltage\":%d, \"RSSI\":%d}",
-                              VERSION, VALVE_DRIVER_TYPE==2? 'H' : 'C',
+        uint32 uplinkTimeout = getLearnedTimeout(&state.rtcMem.uplinkHistogram, UPLINK_HISTOGRAM_UNIT, MIN_UPLINK_TIME, MAX_UPLINK_TIME);
+        uint16 length = os_sprintf(txMessage, "{\"name\":\"SleeperRequest\", \"version\":\"%s%c\", \"time\":\"%u-%02u-%02uT%02u:%02u:%02u.%03uZ\", \"overrideEnd\":\"%u-%02u-%02uT%02u:%02u:%02u.%03uZ\", \"mode\":\"%s\", \"state\":\"%s\", \"programId\":%lu, \"opened\":%u, \"totalOpen\":%lu, \"resistance\":%u, \"voltage\":%d, \"RSSI\":%d, \"timeScale\":%d, \"timeScaleDev\":%d, \"leadTime\":%u, \"batteryDays\":%d, \"awakeBudget\":%ld, \"dayCharge\":%u, \"budgetCuts\":%u, \"uplinkFailures\":%u, \"wlanTimeout\":%lu, \"uplinkTimeout\":%lu",
+                              VERSION, valveGetDriverId(),
                               1900 + nowTMS.tm_year, 1 + nowTMS.tm_mon, nowTMS.tm_mday, nowTMS.tm_hour, nowTMS.tm_min, nowTMS.tm_sec, nowTMS.tm_msec,
                               1900 + tms.tm_year, 1 + tms.tm_mon, tms.tm_mday, tms.tm_hour, tms.tm_min, tms.tm_sec, tms.tm_msec,
                               getSleeperModeAsText(),
-                              state.rtcMem.valveOpen? "ON" : "OFF",
+                              state.rtcMem.valves[0].open? "ON" : "OFF",
                               state.rtcMem.activityProgramId,
-                              state.rtcMem.totalOpenCount,
-                              state.rtcMem.totalOpenDuration,
-                              state.rtcMem.valveResistance,
+                              state.rtcMem.valves[0].openCount,
+                              state.rtcMem.valves[0].openDuration,
+                              state.rtcMem.valves[0].resistance,
                               state.batteryVoltage,
-                              state.rssi);
-        uplink_sendRequest(REMOTE_IP, REMOTE_PORT, txMessage);
+                              state.rssi,
+                              state.rtcMem.downtimeScale - 10000,
+                              driftGetDeviation(&state),
+                              getWakeLeadTime(),
+                              batteryGetDays(&state),
+                              awakeBudget != 0xFFFFFFFF? (sint32)awakeBudget : -1,
+                              state.rtcMem.dayCharge,
+                              state.rtcMem.budgetCuts,
+                              state.rtcMem.uplinkFailures,
+                              wlanTimeout,
+                              uplinkTimeout);
+#if MAX_VALVES > 1
+        length += valveFormat(&state, txMessage + length, sizeof(txMessage) - length - 2);
+#endif
+        length += timingFormat(txMessage + length, sizeof(txMessage) - length - 2);
+        length += traceFormat(&state, txMessage + length, sizeof(txMessage) - length - 2);
+        os_strcpy(txMessage + length, "}");
+        requestTime = system_get_time()/1000;
+        uplink_sendRequest(state.rtcMem.serverIp, state.rtcMem.serverPort, txMessage);
 
         // update state and wait for TCP reply
         uplinkSocketConnected  = true;
-        comTimeout = MAX_UPLINK_TIME;
+        comTimeout = uplinkTimeout;
         break;
 
       case STATION_WRONG_PASSWORD:
-        ets_uart_printf("ERROR: WLAN wrong password, aborting\r\n");
+        LOG_ERROR("ERROR: WLAN wrong password, aborting\r\n");
         comTimeout = 0;
         break;
 
       case STATION_NO_AP_FOUND:
-        ets_uart_printf("ERROR: WLAN AP not found, aborting\r\n");
+        LOG_ERROR("ERROR: WLAN AP not found, aborting\r\n");
         comTimeout = 0;
         break;
 
       case STATION_CONNECT_FAIL:
-        ets_uart_printf("ERROR: WLAN connect failed, aborting\r\n");
+        LOG_ERROR("ERROR: WLAN connect failed, aborting\r\n");
         comTimeout = 0;
         break;
 
       default:
         // waiting for AP connect
-        ets_uart_printf(".");
+        LOG_DEBUG(".");
         wlanConnecting = true;
-        comTimeout -= WLAN_TIMER_PERIOD;
+        comTimeout = (sint32)wlanTimeout - (sint32)(system_get_time()/1000);
     }
   }
   else
@@ -588,6 +1098,17 @@ LOCAL void comTimerCallback(void *arg)
     comTimeout -= UPLINK_TIMER_PERIOD;
   }
 
+  // abandon uplink when energy budget of wake cycle is used up (valve is still operated)
+  if (!valveControlled && comTimeout > 0 && !(uplinkSocketConnected && uplink_hasReceived()) && system_get_time()/1000 >= awakeBudget)
+  {
+    LOG_WARNING("WARNING: awake budget of %lu ms used up, abandoning uplink\r\n", awakeBudget);
+    if (state.rtcMem.budgetCuts < 0xFF)
+    {
+      state.rtcMem.budgetCuts++;
+    }
+    comTimeout = 0;
+  }
+
   if (wlanConnecting && comTimeout > 0)
   {
     // passive wait for WLAN link to AP
@@ -630,43 +1151,96 @@ LOCAL void comTimerCallback(void *arg)
     else
     {
       // process TCP reply or reply receive timeout
-      uint8 mode = state.rtcMem.mode;
-      uint64 start = 0;
-
       char* reply = (char*)uplink_getReply();
-      if (reply[0])
-      {
-        // reply received, parse (takes about 30 ms)
-        parseReply(reply, &mode, &start);
-        //ets_uart_printf("JSON parsing reply completed at %lu ms\r\n", system_get_time()/1000);
-      }
-      else if (wlanConnecting)
+      if (!valveControlled)
       {
-        // WLAN link timeout
-        ets_uart_printf("ERROR: WLAN connect timeout\r\n");
+        uint8 mode = state.rtcMem.mode;
+        uint64 start = 0;
+
+        if (uplink_getRequestTime())
+        {
+          histogramAdd(&state.rtcMem.timingHistograms[TIMING_CONNECT], CONNECT_HISTOGRAM_UNIT, uplink_getRequestTime()/1000 - requestTime);
+        }
+
+        if (reply[0])
+        {
+          // reply received, parse (takes about 30 ms)
+          histogramAdd(&state.rtcMem.uplinkHistogram, UPLINK_HISTOGRAM_UNIT, uplink_getReplyTime()/1000 - requestTime);
+          histogramAdd(&state.rtcMem.timingHistograms[TIMING_REPLY], REPLY_HISTOGRAM_UNIT, (uplink_getReplyTime() - uplink_getRequestTime())/1000);
+          uint32 parseStart = system_get_time();
+          parseReply(reply, &mode, &start);
+          if (timingSent)
+          {
+            // timing histograms were received by server, start next interval
+            for (uint8 i=0; i<TIMING_HISTOGRAMS; i++)
+            {
+              histogramReset(&state.rtcMem.timingHistograms[i]);
+            }
+            state.rtcMem.timingElapsed = 0;
+          }
+          histogramAdd(&state.rtcMem.timingHistograms[TIMING_PARSE], PARSE_HISTOGRAM_UNIT, (system_get_time() - parseStart)/1000);
+          discoveryUplinkResult(&state, true);
+          uplinkReplied = true;
+          traceUploaded(&state);
+          //LOG_DEBUG("JSON parsing reply completed at %lu ms\r\n", system_get_time()/1000);
+        }
+        else if (island)
+        {
+          // RF disabled, operate valves by stored schedule
+        }
+        else if (wlanConnecting)
+        {
+          // WLAN link timeout
+          LOG_ERROR("ERROR: WLAN connect timeout\r\n");
+        }
+        else
+        {
+          // TCP reply timeout
+          LOG_ERROR("ERROR: TCP reply timeout\r\n");
+          discoveryUplinkResult(&state, false);
+        }
+
+        // operate valve (asynchronously)
+        addWakeLatency();
+        nextEventTime = valveControl(&state, mode, start, false, false);
+        valveControlled = true;
       }
-      else
+
+      if (valveIsBusy())
       {
-        // TCP reply timeout
-        ets_uart_printf("ERROR: TCP reply timeout\r\n");
+        // passive wait for valve operation to complete
+#if defined(ESP_SDK_VERSION_NUMBER) && (ESP_SDK_VERSION_NUMBER >= 2)
+        os_timer_arm(&comTimer, VALVE_POLL_PERIOD, false);
+#else
+        os_timer_arm(&comTimer, VALVE_POLL_PERIOD, NULL);
+#endif
       }
-
-      // operate valve
-      nextEventTime = valveControl(&state, mode, start, false, false);
-
-      if (reply[0])
+      else if (reply[0] && system_get_time()/1000 < awakeBudget)
       {
         // reply received, create and send TCP status message
         state.now = getTime();
         esp_gmtime(&state.now, &nowTMS);
-        os_sprintf(txMessage, "{\"name\":\"SleeperStatus\", \"time\":\"%u-%02u-%02uT%02u:%02u:%02u.%03uZ\", \"mode\":\"%s\", \"state\":\"%s\", \"programId\":%lu, \"opened\":%u,  \"totalOpen\":%lu, \"voltage\":%d}",
+        uint16 length = os_sprintf(txMessage, "{\"name\":\"SleeperStatus\", \"time\":\"%u-%02u-%02uT%02u:%02u:%02u.%03uZ\", \"mode\":\"%s\", \"state\":\"%s\", \"programId\":%lu, \"opened\":%u,  \"totalOpen\":%lu, \"voltage\":%d, \"RTT\":%u, \"pulse\":%u, \"latch\":%u",
                               1900 + nowTMS.tm_year, 1 + nowTMS.tm_mon, nowTMS.tm_mday, nowTMS.tm_hour, nowTMS.tm_min, nowTMS.tm_sec, nowTMS.tm_msec,
                               getSleeperModeAsText(),
-                              state.rtcMem.valveOpen? "ON" : "OFF",
+                              state.rtcMem.valves[0].open? "ON" : "OFF",
                               state.rtcMem.activityProgramId,
-                              state.rtcMem.totalOpenCount,
-                              state.rtcMem.totalOpenDuration,
-                              state.batteryVoltage);
+                              state.rtcMem.valves[0].openCount,
+                              state.rtcMem.valves[0].openDuration,
+                              state.batteryVoltage,
+                              state.roundTripTime,
+                              state.rtcMem.lastOpenPulseTime,
+                              state.rtcMem.openLatchTime);
+#if MAX_VALVES > 1
+        length += valveFormat(&state, txMessage + length, sizeof(txMessage) - length - 2);
+#endif
+#if LOG_RING
+        if (logRequested)
+        {
+          length += logFormat(txMessage + length, sizeof(txMessage) - length - 2);
+        }
+#endif
+        os_strcpy(txMessage + length, "}");
         uplink_sendMessage(txMessage);
 
         // passive wait for TCP transmit and disconnect confirmation
@@ -680,7 +1254,7 @@ LOCAL void comTimerCallback(void *arg)
       }
       else
       {
-        // no reply, skip sending status and close uplink
+        // no reply or awake budget used up, skip sending status and close uplink
         if (!uplink_isClosed())
         {
           uplink_close();
@@ -706,73 +1280,52 @@ LOCAL void comTimerCallback(void *arg)
   // ready for shutdown
   if (readyForShutdown)
   {
-    //ets_uart_printf("Sleeper preparing for shutdown at %lu ms\r\n", system_get_time()/1000);
+    //LOG_DEBUG("Sleeper preparing for shutdown at %lu ms\r\n", system_get_time()/1000);
 
     // check uplink connection
     if (!uplink_isClosed())
     {
-      ets_uart_printf("ERROR: TCP connection still open\r\n");
+      LOG_ERROR("ERROR: TCP connection still open\r\n");
     }
 
     // explicitly shutdown WLAN early to prevent sporadically increased quiescent current
     // wifi_station_disconnect() will prolong next AP reconnect by about 1000 ms
     // @todo needs idle state to be effective?
-    if (!wifi_set_sleep_type(MODEM_SLEEP_T))
+    if (!island && !wifi_set_sleep_type(MODEM_SLEEP_T))
     {
-      ets_uart_printf("ERROR: enabling WLAN modem sleep failed\r\n");
+      LOG_ERROR("ERROR: enabling WLAN modem sleep failed\r\n");
     }
 
-    // shutdown valve GPIOs
+    // complete pending valve operation and shutdown valve GPIOs
+    valveFinish();
     valveDriverShutdown();
 
-    // shutdown ADC GPIO
-    adcDriverShutdown();
+    // save valve curves for upload
+    traceSave(&state);
 
-    // estimate current time
+    // estimate current time and save RTC counter to measure downtime
     state.now = getTime();
+    state.rtcMem.shutdownRtcTime = system_get_rtc_time();
     state.rtcMem.lastShutdownTime = state.now;
+    state.rtcMem.shutdownRtcCali = system_rtc_clock_cali_proc();
 
-    // calculate next downtime
-    uint8 needRFCal = true;
-    if (state.rtcMem.valveOpen && state.rtcMem.downtime > MAX_VALVE_OPEN_DOWNTIME)
-    {
-      // valve is open, limit downtime
-      state.rtcMem.lastDowntime = MAX_VALVE_OPEN_DOWNTIME;
-    }
-    else
-    {
-      state.rtcMem.lastDowntime = state.rtcMem.downtime;
-    }
-    uint64 nextValeOperationTime = state.rtcMem.lastShutdownTime + state.rtcMem.lastDowntime + SLEEPER_COMMANDTIME;
-    if (nextEventTime > 0 && nextValeOperationTime > (nextEventTime + 500U))
-    {
-      // next valve operation time will be too late for next event: try to cut back on downtime to hit event
-      uint32 cutBackTime = nextValeOperationTime - (nextEventTime + 500U);
-      if (state.rtcMem.lastDowntime > (SLEEPER_MIN_DOWNTIME + cutBackTime))
-      {
-        // required cut back leaves at least 1 second downtime: apply cut back
-        state.rtcMem.lastDowntime -= cutBackTime;
-      }
-      else
-      {
-        // required cut back does not leave at least 1 second downtime: limit cut back and accept delay
-        state.rtcMem.lastDowntime = SLEEPER_MIN_DOWNTIME;
-      }
+    // calculate next downtime and RF mode
+    uint8 needRFCal = scheduleDowntime(nextEventTime);
+    uint8 needRF = scheduleUplink();
 
-      // skip RF calibration if downtime is less than quarter of regular downtime
-      needRFCal = 4*state.rtcMem.lastDowntime < state.rtcMem.downtime;
-    }
+    // account awake time for battery model
+    batteryAddWake(&state, system_get_time()/1000 + state.rtcMem.boottime);
 
     // backup state to RTC memory
     if (!system_rtc_mem_write(64, &state.rtcMem, sizeof(state.rtcMem)))
     {
-      ets_uart_printf("ERROR: writing to RTC memory failed\r\n");
+      LOG_ERROR("ERROR: writing to RTC memory failed\r\n");
     }
 
     // say goodbye
     esp_gmtime(&state.rtcMem.lastShutdownTime, &tms);
-    uint8 deepSleepOption = needRFCal? RF_DEFAULT : RF_NO_CAL;
-    ets_uart_printf("going to sleep for %lu seconds at %02u:%02u:%02u.%03uZ %02u.%02u.%u with deep sleep option %u (uptime %lu ms)\r\n", state.rtcMem.lastDowntime/1000, tms.tm_hour, tms.tm_min, tms.tm_sec, tms.tm_msec, tms.tm_mday, 1 + tms.tm_mon, 1900 + tms.tm_year, deepSleepOption, system_get_time()/1000);
+    uint8 deepSleepOption = needRF? (needRFCal? RF_DEFAULT : RF_NO_CAL) : RF_DISABLED;
+    LOG_INFO("going to sleep for %lu seconds at %02u:%02u:%02u.%03uZ %02u.%02u.%u with deep sleep option %u (uptime %lu ms)\r\n", state.rtcMem.lastDowntime/1000, tms.tm_hour, tms.tm_min, tms.tm_sec, tms.tm_msec, tms.tm_mday, 1 + tms.tm_mon, 1900 + tms.tm_year, deepSleepOption, system_get_time()/1000);
 
     // go to deep sleep (set init_data byte 108 to the number of wakeups for next RF_CAL)
     system_deep_sleep_set_option(deepSleepOption);
@@ -788,7 +1341,7 @@ LOCAL void wifiEventCallback(System_Event_t *evt)
   switch (evt->event)
   {
     case EVENT_STAMODE_CONNECTED:
-      //ets_uart_printf("WLAN event: connected\r\n");
+      //LOG_DEBUG("WLAN event: connected\r\n");
       if (wifi_station_dhcpc_status() == DHCP_STOPPED)
       {
         // open uplink immediately after connecting to AP
@@ -796,7 +1349,7 @@ LOCAL void wifiEventCallback(System_Event_t *evt)
       }
       break;
     case EVENT_STAMODE_GOT_IP:
-      //ets_uart_printf("WLAN event: got IP\r\n");
+      //LOG_DEBUG("WLAN event: got IP\r\n");
       if (wifi_station_dhcpc_status() == DHCP_STARTED)
       {
         // open uplink after receiving IP address
@@ -852,47 +1405,69 @@ uint32 ICACHE_FLASH_ATTR user_rf_cal_sector_set()
   return rf_cal_sector;
 }
 
+/**
+ * get flash sector for user data, allocated downwards below the RF_CAL sector
+ */
+uint32 ICACHE_FLASH_ATTR getUserDataSector(uint8 index)
+{
+  return user_rf_cal_sector_set() - 1 - index;
+}
+
 /**
  * system setup
  */
 void ICACHE_FLASH_ATTR user_init()
 {
-  ets_uart_printf("Gardena 9V solenoid irrigation valve controller ver: " VERSION "\r\n");
-  ets_uart_printf("Copyright (c) 2015-2019 jnsbyr, Germany\r\n\r\n");
+#if LOG_RING || LOG_LEVEL == LOG_LEVEL_NONE
+  // no UART output by SDK
+  system_set_os_print(0);
+#endif
+  LOG_INFO("Gardena 9V solenoid irrigation valve controller ver: " VERSION "\r\n");
+  LOG_INFO("Copyright (c) 2015-2026 jnsbyr, Germany\r\n\r\n");
 
   // configure valve GPIOs
   valveDriverInit();
 
-  // configure ADC GPIO
-  adcDriverInit();
-
   // read RTC memory
   uint8 reinitState = false;
   if (system_rtc_mem_read(64, &state.rtcMem, sizeof(state.rtcMem)))
   {
     if (state.rtcMem.magic != SLEEPER_STATE_MAGIC)
     {
-      ets_uart_printf("WARNING: RTC memory lost\r\n");
+      LOG_WARNING("WARNING: RTC memory lost\r\n");
       state.rtcMem.batteryOffset = 0; // config, millivolt, every chip seems to have different ADC offset up to 200 mV
       reinitState = true;
     }
   }
   else
   {
-    ets_uart_printf("ERROR: reading from RTC memory failed\r\n");
+    LOG_ERROR("ERROR: reading from RTC memory failed\r\n");
     reinitState = true;
   }
 
-  //ets_uart_printf("readvdd33 %u\r\n", readvdd33());
-  //ets_uart_printf("system_get_vdd33 %u\r\n", system_get_vdd33());
-  //ets_uart_printf("phy_get_vdd33 %u\r\n", phy_get_vdd33());
+  //LOG_DEBUG("readvdd33 %u\r\n", readvdd33());
+  //LOG_DEBUG("system_get_vdd33 %u\r\n", system_get_vdd33());
+  //LOG_DEBUG("phy_get_vdd33 %u\r\n", phy_get_vdd33());
 
   // read vdd before operating valve and entering station mode (system_get_vdd33() requires modifying the default esp init data byte 107 0->255 and RF to be up)
-  os_delay_us(30); // settle time [us]
-  state.batteryVoltage = readvdd33() + state.rtcMem.batteryOffset;
+  island = !reinitState && state.rtcMem.islandWakes > 0;
+  if (island)
+  {
+    // vdd33 is not measured with RF disabled, use smoothed battery voltage
+    state.batteryVoltage = (state.rtcMem.batteryLevel + 4) >> 3;
+  }
+  else
+  {
+    os_delay_us(30); // settle time [us]
+    state.batteryVoltage = readvdd33() + state.rtcMem.batteryOffset;
+  }
 
   // init state
   state.timeSynchronized = false;
+  state.roundTripTime = 0;
+  state.measuredDowntime = reinitState? 0 : measureDowntime();
+  state.latencyValid = !reinitState;
+  bool userWakeup = isUserWakeup();
 
   // cold boot init required?
   if (reinitState)
@@ -906,6 +1481,29 @@ void ICACHE_FLASH_ATTR user_init()
     state.rtcMem.mode            = MODE_OFF;                 // config
     state.rtcMem.activityProgramId  = 0;                     // config
     state.rtcMem.maxValveResistance = 0;                     // config
+    state.rtcMem.autoTimeScale   = true;                     // config
+    state.rtcMem.leadPercentile  = DEFAULT_LEAD_PERCENTILE;  // config
+    state.rtcMem.stretchDays     = DEFAULT_STRETCH_DAYS;     // config
+    state.rtcMem.maxStretch      = DEFAULT_MAX_STRETCH;      // config
+    state.rtcMem.wakeBudget      = DEFAULT_WAKE_BUDGET;      // config
+    state.rtcMem.uplinkFailures  = 0;
+    state.rtcMem.islandWakes     = 0;
+    histogramReset(&state.rtcMem.wlanHistogram);
+    histogramReset(&state.rtcMem.uplinkHistogram);
+    for (uint8 i=0; i<TIMING_HISTOGRAMS; i++)
+    {
+      histogramReset(&state.rtcMem.timingHistograms[i]);
+    }
+    state.rtcMem.timingInterval  = DEFAULT_TIMING_INTERVAL;  // config
+    state.rtcMem.timingElapsed   = 0;
+    state.rtcMem.dayBudget       = DEFAULT_DAY_BUDGET;       // config
+    state.rtcMem.latencySampleCount = 0;
+    state.rtcMem.latencySampleNext  = 0;
+    os_memset(&state.rtcMem.timeZone, 0, sizeof(state.rtcMem.timeZone)); // config, UTC
+    state.rtcMem.pulseProfile.openPulse  = HBRIDGE_OPEN_PULSE_DURATION/100;  // config
+    state.rtcMem.pulseProfile.closePulse = HBRIDGE_CLOSE_PULSE_DURATION/100; // config
+    state.rtcMem.pulseProfile.settleTime = GENERATOR_SETTLE_TIME/100;        // config
+    state.rtcMem.pulseProfile.shortTime  = VALVE_SHORT_TIME/100;             // config
     tms.tm_mday = 1;
     tms.tm_mon  = 0;
     tms.tm_year = 70;
@@ -915,193 +1513,272 @@ void ICACHE_FLASH_ATTR user_init()
     tms.tm_msec = 0;
     state.rtcMem.lastShutdownTime = esp_mktime(&tms);
     state.rtcMem.lastDowntime = 0;
+    state.rtcMem.shutdownRtcTime = 0;
+    state.rtcMem.shutdownRtcCali = 0;
     state.rtcMem.offMode = MODE_OFF;
     state.rtcMem.overriddenMode = MODE_OFF;
-    state.rtcMem.lastValveOperationStatus = VALVE_STATUS_UNKNOWN;
-    state.rtcMem.valveOpen = true;  // preset to force immediate closing
     state.rtcMem.override = false;
     state.rtcMem.lowBattery = false;
     state.rtcMem.ipConfig.ip.addr = 0;
     state.rtcMem.valveSupplyVoltage = 0;  // preset to force detection
-    state.rtcMem.valveResistance = 0;
-    state.rtcMem.valveOpenTime = 0;
-    state.rtcMem.valveCloseTime = 0;
-    state.rtcMem.valveCloseTimeEstimated = 0;
+    state.rtcMem.valveCapacitance = 0;
+    state.rtcMem.tracePending = false;
+    state.rtcMem.openPulseMargin = VALVE_OPEN_PULSE_MARGIN; // config
+    state.rtcMem.openLatchTime = 0;
+    state.rtcMem.lastOpenPulseTime = 0;
     state.rtcMem.overrideEndTime = 0;
     state.rtcMem.overrideEndTimeEstimated = false;
     state.rtcMem.lowBatteryTime = 0;
     state.rtcMem.lowBatteryTimeEstimated = false;
-    state.rtcMem.totalOpenCount = 0;
-    state.rtcMem.totalOpenDuration = 0;
+    for (uint8 i=0; i<MAX_VALVES; i++)
+    {
+      ValveStateT* valve = &state.rtcMem.valves[i];
+      valve->open               = true;  // preset to force immediate closing
+      valve->closeTimeEstimated = false;
+      valve->status             = VALVE_STATUS_UNKNOWN;
+      valve->resistance         = 0;
+      valve->openCount          = 0;
+      valve->openDuration       = 0;
+      valve->openTime           = 0;
+      valve->closeTime          = 0;
+    }
+    driftReset(&state);
+    batteryReset(&state);
+    discoveryLoad(&state);
     for (uint16 i = 0; i < MAX_ACTIVITIES; i++)
     {
       // mark all activity slots as invalid
       ActivityT* activity = &state.rtcMem.activities[i];
       activity->day       = DAY_INVALID;
     }
-    ets_uart_printf("WARNING: time set to %02u:%02u:%02u.%03uZ %02u.%02u.%u\r\n", tms.tm_hour, tms.tm_min, tms.tm_sec, tms.tm_msec, tms.tm_mday, 1 + tms.tm_mon, 1900 + tms.tm_year);
+    LOG_WARNING("WARNING: time set to %02u:%02u:%02u.%03uZ %02u.%02u.%u\r\n", tms.tm_hour, tms.tm_min, tms.tm_sec, tms.tm_msec, tms.tm_mday, 1 + tms.tm_mon, 1900 + tms.tm_year);
 
     // backup initial state to RTC memory
     if (!system_rtc_mem_write(64, &state.rtcMem, sizeof(state.rtcMem)))
     {
-      ets_uart_printf("ERROR: writing to RTC memory failed\r\n");
+      LOG_ERROR("ERROR: writing to RTC memory failed\r\n");
     }
 
-    ets_uart_printf("sleeper: uptime %lu ms, valve %s\r\n", system_get_time()/1000, state.rtcMem.valveOpen? "open" : "closed");
+    LOG_INFO("sleeper: uptime %lu ms, valve %s\r\n", system_get_time()/1000, state.rtcMem.valves[0].open? "open" : "closed");
+
+#if SCENARIO_BENCHMARK
+    // benchmark wake cycles on virtual clock
+    scenarioRun(&state);
+#endif
+  }
+  else if (userWakeup)
+  {
+    // deep sleep was cut short by user, not usable for drift tracking
   }
+  else if (state.measuredDowntime)
+  {
+    // account last deep sleep for drift tracking
+    sint32 error = state.measuredDowntime - (state.rtcMem.lastDowntime + state.rtcMem.boottime);
+    LOG_INFO("downtime %lu ms measured, %ld ms estimate error\r\n", state.measuredDowntime, error);
+    driftAddMeasuredSleep(&state, state.rtcMem.lastDowntime, error);
+  }
+  else
+  {
+    // account last deep sleep for drift tracking
+    driftAddSleep(&state, state.rtcMem.lastDowntime);
+  }
+
+  // account last deep sleep and battery voltage for battery model, duration of user wakeup is only known if measured
+  uint32 slept = reinitState || (userWakeup && !state.measuredDowntime)? 0 : getDowntime();
+  batteryAddSleep(&state, slept);
+  state.rtcMem.timingElapsed += slept/1000;
 
   // check battery voltage
-  bool userWakeup = isUserWakeup();
   state.now = getTime();
   if (!state.rtcMem.lowBattery && state.batteryVoltage < MIN_BATTERY_VOLTAGE)
   {
     // low battery condition
-    ets_uart_printf("WARNING: low battery voltage %d mV (required %d mV)\r\n", state.batteryVoltage, MIN_BATTERY_VOLTAGE);
+    LOG_WARNING("WARNING: low battery voltage %d mV (required %d mV)\r\n", state.batteryVoltage, MIN_BATTERY_VOLTAGE);
     state.rtcMem.lowBattery = true;
     state.rtcMem.lowBatteryTime = state.now + LOW_BATTERY_REPORTING_DURATION;
     state.rtcMem.lowBatteryTimeEstimated = true;
   }
   if (state.rtcMem.lowBattery)
   {
-    // try to close open valve
-    if (state.rtcMem.valveOpen)
+    // try to close open valves
+    if (valveIsAnyOpen(&state))
     {
       valveControl(&state, MODE_OFF, 0, false, false);
+      valveFinish();
     }
 
     // backup new valve state to RTC memory
     if (!system_rtc_mem_write(64, &state.rtcMem, sizeof(state.rtcMem)))
     {
-      ets_uart_printf("ERROR: writing to RTC memory failed\r\n");
+      LOG_ERROR("ERROR: writing to RTC memory failed\r\n");
     }
 
     // enter permanent deep sleep for maximum battery lifetime after reporting duration has expired
     if (!userWakeup && state.now >= state.rtcMem.lowBatteryTime + LOW_BATTERY_REPORTING_DURATION)
     {
-      ets_uart_printf("WARNING: low battery shutdown\r\n");
+      LOG_WARNING("WARNING: low battery shutdown\r\n");
 
       system_deep_sleep_set_option(RF_DISABLED);
       system_deep_sleep_instant(0);
     }
     else
     {
-      ets_uart_printf("WARNING: LOW BATTERY\r\n");
+      LOG_WARNING("WARNING: LOW BATTERY\r\n");
     }
   }
 
   // wakeup caused by user?
   if (userWakeup)
   {
-    ets_uart_printf("wakeup by user\r\n");
+    LOG_INFO("wakeup by user\r\n");
 
     // try to toggle valve
     valveControl(&state, MODE_OFF, state.now, true, false);
 
     // precompensate timekeeping for early wakeup by one runtime in case of setTime = false or no WLAN
-    state.rtcMem.lastDowntime -= SLEEPER_COMMANDTIME;
+    if (!state.measuredDowntime)
+    {
+      state.rtcMem.lastDowntime -= SLEEPER_COMMANDTIME;
+    }
+
+    // actual sleep duration is unknown, discard current drift sample
+    driftInvalidate(&state);
+    state.latencyValid = false;
+
+    // attempt uplink in next wake cycle if RF is disabled
+    state.rtcMem.islandWakes = 0;
 
     // backup new valve state immediately to RTC memory to provide full manual control even if WLAN connect fails
     if (!system_rtc_mem_write(64, &state.rtcMem, sizeof(state.rtcMem)))
     {
-      ets_uart_printf("ERROR: writing to RTC memory failed\r\n");
+      LOG_ERROR("ERROR: writing to RTC memory failed\r\n");
     }
   }
 
-  // configure WLAN operation mode
-  uint8 setWLANOpMode = STATION_MODE;
-  if (wifi_get_opmode() != setWLANOpMode)
+  // limit awake time by energy budget
+  awakeBudget = batteryStartWake(&state);
+
+  // prepare pending valve operation in parallel to WLAN connect
+  valvePrepare(&state);
+
+  if (island)
   {
-    ets_uart_printf("setting WLAN operation mode %u\r\n", setWLANOpMode);
-    if (!wifi_set_opmode(setWLANOpMode)) // persistent, default SOFTAP_MODE
-    {
-      ets_uart_printf("ERROR: changing WLAN operation mode failed\r\n");
-    }
+    // RF is disabled (island mode), operate valves without uplink
+    LOG_INFO("island mode, %u wake cycles until next uplink attempt\r\n", state.rtcMem.islandWakes);
+    comTimeout = 0;
   }
-
-  // reuse last DHCP IP address to speed up ready state (saves about 3000 ms)
-  if (state.rtcMem.ipConfig.ip.addr)
+  else
   {
-    // disable WLAN DHCP client
-    ets_uart_printf("WLAN disabling DHCP client\r\n");
-    if (!wifi_station_dhcpc_stop())
+    // configure WLAN operation mode
+    uint8 setWLANOpMode = STATION_MODE;
+    if (wifi_get_opmode() != setWLANOpMode)
     {
-      ets_uart_printf("ERROR: disabling WLAN station DHCP client failed\r\n");
+      LOG_INFO("setting WLAN operation mode %u\r\n", setWLANOpMode);
+      if (!wifi_set_opmode(setWLANOpMode)) // persistent, default SOFTAP_MODE
+      {
+        LOG_ERROR("ERROR: changing WLAN operation mode failed\r\n");
+      }
     }
 
-    // set WLAN station IP address
-    ets_uart_printf("WLAN setting station IP address to " IPSTR "\r\n", IP2STR(&state.rtcMem.ipConfig.ip));
-    if (!wifi_set_ip_info(STATION_IF, &state.rtcMem.ipConfig))
+    // reuse last DHCP IP address to speed up ready state (saves about 3000 ms)
+    if (state.rtcMem.ipConfig.ip.addr)
     {
-      ets_uart_printf("ERROR: changing WLAN station IP address failed\r\n");
-    }
+      // disable WLAN DHCP client
+      LOG_INFO("WLAN disabling DHCP client\r\n");
+      if (!wifi_station_dhcpc_stop())
+      {
+        LOG_ERROR("ERROR: disabling WLAN station DHCP client failed\r\n");
+      }
 
-    comTimeout = MAX_WLAN_TIME/2; // milliseconds ~4 s
-  }
-  else
-  {
-    comTimeout = MAX_WLAN_TIME; // milliseconds ~8 s
-  }
+      // set WLAN station IP address
+      LOG_INFO("WLAN setting station IP address to " IPSTR "\r\n", IP2STR(&state.rtcMem.ipConfig.ip));
+      if (!wifi_set_ip_info(STATION_IF, &state.rtcMem.ipConfig))
+      {
+        LOG_ERROR("ERROR: changing WLAN station IP address failed\r\n");
+      }
 
-  // configure WLAN station
-  struct station_config actStationConfig;
-  if (wifi_station_get_config(&actStationConfig))
-  {
-    struct station_config setStationConfig;
-    os_memset(&setStationConfig, 0, sizeof(setStationConfig));
-    os_sprintf(setStationConfig.ssid, "%s", WLAN_SSID);
-    os_sprintf(setStationConfig.password, "%s", WLAN_PSK);
-    if (os_memcmp(actStationConfig.password, setStationConfig.password, sizeof(setStationConfig.password)))
+      comTimeout = getLearnedTimeout(&state.rtcMem.wlanHistogram, WLAN_HISTOGRAM_UNIT, MIN_WLAN_TIME, MAX_WLAN_TIME/2); // milliseconds, learned or ~4 s
+    }
+    else
     {
-      ets_uart_printf("updating WLAN station configuration\r\n");
-      reinitState = true;
-      if (!wifi_station_set_config(&setStationConfig)) // persistent
+      comTimeout = MAX_WLAN_TIME; // milliseconds ~8 s
+    }
+
+    // configure WLAN station
+    struct station_config actStationConfig;
+    if (wifi_station_get_config(&actStationConfig))
+    {
+      struct station_config setStationConfig;
+      os_memset(&setStationConfig, 0, sizeof(setStationConfig));
+      os_sprintf(setStationConfig.ssid, "%s", WLAN_SSID);
+      os_sprintf(setStationConfig.password, "%s", WLAN_PSK);
+      if (os_memcmp(actStationConfig.password, setStationConfig.password, sizeof(setStationConfig.password)))
       {
-        ets_uart_printf("ERROR: changing WLAN station configuration failed\r\n");
+        LOG_INFO("updating WLAN station configuration\r\n");
+        reinitState = true;
+        if (!wifi_station_set_config(&setStationConfig)) // persistent
+        {
+          LOG_ERROR("ERROR: changing WLAN station configuration failed\r\n");
+        }
       }
     }
-  }
-  else
-  {
-    ets_uart_printf("ERROR: getting WLAN station configuration failed\r\n");
-  }
+    else
+    {
+      LOG_ERROR("ERROR: getting WLAN station configuration failed\r\n");
+    }
 
-  // enable WLAN station auto connect
-  if (!wifi_station_get_auto_connect())
-  {
-    ets_uart_printf("enabling WLAN station auto connect at power on\r\n");
-    if (!wifi_station_set_auto_connect(true)) // persistent, default true
+    // enable WLAN station auto connect
+    if (!wifi_station_get_auto_connect())
     {
-      ets_uart_printf("ERROR: enabling WLAN station auto connect at power failed\r\n");
+      LOG_INFO("enabling WLAN station auto connect at power on\r\n");
+      if (!wifi_station_set_auto_connect(true)) // persistent, default true
+      {
+        LOG_ERROR("ERROR: enabling WLAN station auto connect at power failed\r\n");
+      }
     }
-  }
 
-  // limit WLAN speed to save power
-  if (wifi_get_phy_mode() != PHY_MODE_11G)
-  {
-    ets_uart_printf("forcing IEEE 802.11G mode\r\n");
-    if (!wifi_set_phy_mode(PHY_MODE_11G)) // persistent
+    // limit WLAN speed to save power
+    if (wifi_get_phy_mode() != PHY_MODE_11G)
     {
-      ets_uart_printf("ERROR: forcing IEEE 802.11G mode failed\r\n");
+      LOG_INFO("forcing IEEE 802.11G mode\r\n");
+      if (!wifi_set_phy_mode(PHY_MODE_11G)) // persistent
+      {
+        LOG_ERROR("ERROR: forcing IEEE 802.11G mode failed\r\n");
+      }
     }
   }
 
   // init state
+  wlanTimeout           = comTimeout;
   uplinkSocketConnected = false;
+  discovering           = false;
+  uplinkReplied         = false;
+  timingSent            = false;
+#if LOG_RING
+  logRequested          = false;
+#endif
   statusSent            = false;
   readyForShutdown      = false;
+  valveControlled       = false;
   nextEventTime         = 0;
 
   // register WLAN event handler
   wifi_set_event_handler_cb(wifiEventCallback);
 
-  // passive wait for WLAN connection
+  // passive wait for WLAN connection (check earlier if WLAN timeout or awake budget is shorter)
+  uint32 uptime = system_get_time()/1000;
+  uint32 firstCheck = awakeBudget > uptime + MAX_WLAN_TIME/2? MAX_WLAN_TIME/2 : (awakeBudget > uptime? awakeBudget - uptime : 1); // milliseconds
+  if (wlanTimeout < uptime + firstCheck)
+  {
+    firstCheck = wlanTimeout > uptime? wlanTimeout - uptime : 1;
+  }
   os_timer_disarm(&comTimer);
   os_timer_setfn(&comTimer, (os_timer_func_t*) comTimerCallback, NULL);
 #if defined(ESP_SDK_VERSION_NUMBER) && (ESP_SDK_VERSION_NUMBER >= 2)
-  os_timer_arm(&comTimer, MAX_WLAN_TIME/2, false); // milliseconds timeout
+  os_timer_arm(&comTimer, firstCheck, false); // milliseconds timeout
 #else
-  os_timer_arm(&comTimer, MAX_WLAN_TIME/2, NULL); // milliseconds timeout
+  os_timer_arm(&comTimer, firstCheck, NULL); // milliseconds timeout
 #endif
 
-  //ets_uart_printf("Sleeper init completed in %lu ms!\r\n", system_get_time()/1000);
+  //LOG_DEBUG("Sleeper init completed in %lu ms!\r\n", system_get_time()/1000);
 }
@@ -0,0 +1,281 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    scenario.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * Wake cycle benchmark (SCENARIO_BENCHMARK). At cold boot, the scenario
+ * program, mode and user wakeups are run through valveControl and
+ * scheduleDowntime on a virtual clock for SCENARIO_DAYS. The deep sleep
+ * timer is assumed to be exact. Uplink time comes from a network model
+ * with random connect jitter and reply loss. Valve operations use the
+ * simulated driver in real time. The state is restored afterwards.
+ *
+ * Per day, the number of wakes, the RF on time, the awake time, the delay
+ * of valve operations after their scheduled time and the estimated charge
+ * are logged, followed by daily averages. Compare the output of a build
+ * with a scheduling or sleep policy change against the current build as
+ * the baseline.
+ *
+ *****************************************************************************/
+
+#include "scenario.h"
+
+#if SCENARIO_BENCHMARK
+
+#include <osapi.h>
+#include <user_interface.h>
+
+#include "esp_time.h"
+#include "valve.h"
+
+#define MS_PER_DAY (1000ULL*SECONDS_PER_DAY)
+
+typedef struct
+{
+  uint8  day;            // day of scenario
+  uint16 minute;         // minutes since midnight UTC
+} ScenarioEventT;
+
+typedef struct
+{
+  uint32 wakes;
+  uint32 rfTime;         // [ms]
+  uint32 awakeTime;      // [ms]
+  uint64 sleepTime;      // [ms]
+  uint32 operations;     // valve operations
+  uint32 maxDelay;       // [ms] max. delay of valve operation after scheduled time
+  uint64 sumDelay;       // [ms]
+} ScenarioStatsT;
+
+// program: every day 06:00 for 10 min, every 2nd day 20:00 for 5 min, 2nd valve every day 06:15 for 10 min
+LOCAL const ActivityT program[] =
+{
+  {DAY_EVERY,  0,  6*60,      600},
+  {DAY_SECOND, 0, 20*60,      300},
+  {DAY_EVERY,  1,  6*60 + 15, 600}
+};
+
+// user wakeups: manual open and close after 5 min, manual open with default duration
+LOCAL const ScenarioEventT userWakeups[] =
+{
+  {2,  7*60},
+  {2,  7*60 + 5},
+  {9, 19*60}
+};
+
+LOCAL SleeperStateT backup;
+LOCAL uint32 seed = 1;
+
+/**
+ * pseudo random number
+ *
+ * @return 0 .. 32767
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR scenarioRandom()
+{
+  seed = 1103515245UL*seed + 12345;
+  return (seed >> 16) & 0x7FFF;
+}
+
+/**
+ * @return milliseconds since scheduled start of current activity of valve
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR getActivityDelay(SleeperStateT* sleeperState, uint8 valve)
+{
+  uint64 local = sleeperState->now + 60000LL*esp_tzoffset(&sleeperState->now, &sleeperState->rtcMem.timeZone);
+  uint32 msOfDay = local%MS_PER_DAY;
+  uint32 delay = 0xFFFFFFFF;
+  for (uint8 i=0; i<MAX_ACTIVITIES && sleeperState->rtcMem.activities[i].day != DAY_INVALID; i++)
+  {
+    const ActivityT* activity = &sleeperState->rtcMem.activities[i];
+    uint32 start = 60000UL*activity->startTime;
+    if (activity->valve == valve && start <= msOfDay && msOfDay - start < delay)
+    {
+      delay = msOfDay - start;
+    }
+  }
+  return delay;
+}
+
+/**
+ * add delay of valve operation to statistics
+ */
+LOCAL void ICACHE_FLASH_ATTR addDelay(ScenarioStatsT* stats, uint32 delay)
+{
+  stats->operations++;
+  stats->sumDelay += delay;
+  if (delay > stats->maxDelay)
+  {
+    stats->maxDelay = delay;
+  }
+}
+
+/**
+ * @return estimated charge [uAh]
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR getCharge(const ScenarioStatsT* stats)
+{
+  return ((uint64)stats->awakeTime*AWAKE_CURRENT*1000 + stats->sleepTime*SLEEP_CURRENT)/3600000UL;
+}
+
+/**
+ * run wake cycles of scenario on virtual clock
+ */
+void ICACHE_FLASH_ATTR scenarioRun(SleeperStateT* sleeperState)
+{
+  PersistentStateT* rtcMem = &sleeperState->rtcMem;
+  os_memcpy(&backup, sleeperState, sizeof(backup));
+  uint32 t0 = system_get_time();
+
+  // install scenario
+  os_memset(rtcMem->activities, 0, sizeof(rtcMem->activities));
+  os_memcpy(rtcMem->activities, program, sizeof(program));
+  rtcMem->mode = MODE_AUTO;
+  rtcMem->downtime = SCENARIO_DOWNTIME;
+  for (uint8 i=0; i<MAX_VALVES; i++)
+  {
+    rtcMem->valves[i].open = false;
+    rtcMem->valves[i].status = VALVE_STATUS_OK;
+  }
+  uint64 start = rtcMem->lastShutdownTime - rtcMem->lastShutdownTime%MS_PER_DAY;
+  rtcMem->lastShutdownTime = start;
+  rtcMem->lastDowntime = SLEEPER_MIN_DOWNTIME;
+  LOG_INFO("scenario: %u days, downtime %lu ms, connect %u+%u ms, reply %u ms, loss %u%%\r\n", SCENARIO_DAYS, rtcMem->downtime,
+           SCENARIO_CONNECT_TIME, SCENARIO_CONNECT_JITTER, SCENARIO_REPLY_TIME, SCENARIO_LOSS_RATE);
+
+  ScenarioStatsT day;
+  ScenarioStatsT total;
+  os_memset(&day, 0, sizeof(day));
+  os_memset(&total, 0, sizeof(total));
+  uint8 dayIndex = 0;
+  uint8 event = 0;
+  while (dayIndex < SCENARIO_DAYS)
+  {
+    // next wakeup by deep sleep timer or by user
+    uint64 wake = rtcMem->lastShutdownTime + rtcMem->lastDowntime + rtcMem->boottime;
+    uint8 userWakeup = false;
+    if (event < sizeof(userWakeups)/sizeof(userWakeups[0]))
+    {
+      uint64 eventTime = start + userWakeups[event].day*MS_PER_DAY + 60000UL*userWakeups[event].minute;
+      if (eventTime < wake)
+      {
+        wake = eventTime;
+        userWakeup = true;
+      }
+    }
+
+    // day completed
+    if (wake >= start + (dayIndex + 1)*MS_PER_DAY)
+    {
+      LOG_INFO("scenario: day %2u %3lu wakes, RF %6lu ms, awake %6lu ms, %lu valve operations, max. delay %lu ms, %lu uAh\r\n",
+               dayIndex + 1, day.wakes, day.rfTime, day.awakeTime, day.operations, day.maxDelay, getCharge(&day));
+      total.wakes      += day.wakes;
+      total.rfTime     += day.rfTime;
+      total.awakeTime  += day.awakeTime;
+      total.sleepTime  += day.sleepTime;
+      total.operations += day.operations;
+      total.sumDelay   += day.sumDelay;
+      if (day.maxDelay > total.maxDelay)
+      {
+        total.maxDelay = day.maxDelay;
+      }
+      os_memset(&day, 0, sizeof(day));
+      dayIndex++;
+      continue;
+    }
+
+    day.sleepTime += wake - rtcMem->lastShutdownTime;
+    event += userWakeup;
+
+    // user wakeup toggles valve before connecting
+    setTime(wake + SCENARIO_PROCESS_TIME);
+    if (userWakeup)
+    {
+      uint8 wasOpen = rtcMem->valves[0].open;
+      valveControl(sleeperState, MODE_OFF, getTime(), true, false);
+      if (rtcMem->valves[0].open != wasOpen)
+      {
+        addDelay(&day, sleeperState->now - wake);
+      }
+    }
+
+    // uplink
+    uint32 rfTime = SCENARIO_CONNECT_TIME + scenarioRandom()%(SCENARIO_CONNECT_JITTER + 1);
+    uint8 replied = scenarioRandom()%100 >= SCENARIO_LOSS_RATE;
+    rfTime += replied? SCENARIO_REPLY_TIME : MAX_UPLINK_TIME;
+    sleeperState->timeSynchronized = replied;
+    setTime(getTime() + rfTime);
+
+    // operate valves
+    uint8 wasOpen[MAX_VALVES];
+    uint64 closeTime[MAX_VALVES];
+    for (uint8 i=0; i<MAX_VALVES; i++)
+    {
+      wasOpen[i]   = rtcMem->valves[i].open;
+      closeTime[i] = rtcMem->valves[i].closeTime;
+    }
+    uint64 nextEventTime = valveControl(sleeperState, rtcMem->mode, 0, false, false);
+    for (uint8 i=0; i<MAX_VALVES; i++)
+    {
+      if (!wasOpen[i] && rtcMem->valves[i].open)
+      {
+        uint32 delay = getActivityDelay(sleeperState, i);
+        if (delay != 0xFFFFFFFF)
+        {
+          addDelay(&day, delay);
+        }
+      }
+      else if (wasOpen[i] && !rtcMem->valves[i].open && closeTime[i] && sleeperState->now >= closeTime[i])
+      {
+        addDelay(&day, sleeperState->now - closeTime[i]);
+      }
+    }
+    valveFinish();
+
+    // status message
+    if (replied)
+    {
+      rfTime += SCENARIO_REPLY_TIME;
+      setTime(getTime() + SCENARIO_REPLY_TIME);
+    }
+
+    // shutdown
+    rtcMem->lastShutdownTime = getTime();
+    scheduleDowntime(nextEventTime);
+    day.wakes++;
+    day.rfTime += rfTime;
+    day.awakeTime += rtcMem->lastShutdownTime - wake + rtcMem->boottime;
+    system_soft_wdt_feed();
+  }
+
+  LOG_INFO("scenario: average per day %lu wakes, RF %lu ms, awake %lu ms, %lu valve operations, mean delay %lu ms, max. delay %lu ms, %lu uAh\r\n",
+           total.wakes/SCENARIO_DAYS, total.rfTime/SCENARIO_DAYS, total.awakeTime/SCENARIO_DAYS, total.operations/SCENARIO_DAYS,
+           total.operations? (uint32)(total.sumDelay/total.operations) : 0, total.maxDelay, getCharge(&total)/SCENARIO_DAYS);
+  LOG_INFO("scenario: completed in %lu ms\r\n", (system_get_time() - t0)/1000);
+
+  // restore state and real time
+  os_memcpy(sleeperState, &backup, sizeof(backup));
+  setTime(0);
+}
+
+#endif /* SCENARIO_BENCHMARK */
@@ -0,0 +1,248 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    trace.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ *
+ * The capacitor voltage curves of a valve operation are downsampled to a
+ * fixed number of points. The time constant of each curve is fitted with
+ * linear least squares through the origin after linearizing the RC model:
+ *
+ *   ln((U(0) - Uinf)/(U(t) - Uinf)) = t/tau
+ *
+ * The curves of the last valve operation are saved to a flash sector at
+ * shutdown, because RTC memory is too small, and are uploaded with the
+ * next request.
+ *
+ *****************************************************************************/
+
+#include "trace.h"
+
+#include <osapi.h>
+#include <user_interface.h>
+
+#include "fixmath.h"
+
+#define TRACE_MAGIC 0x5452
+
+typedef struct          // 4 + C*(8 + P*4) Byte
+{
+  uint16 magic;
+  uint8  curves;        // bit mask of valid curves
+  uint8  reserved;
+  TraceCurveT curve[TRACE_CURVES];
+} TraceT;
+
+LOCAL TraceT trace;
+LOCAL TraceCurveT* current;
+LOCAL uint32 interval; // [us] min. time between points of current curve
+LOCAL uint8 captured;  // bit mask of curves captured since boot and not yet uploaded
+LOCAL uint8 formatted; // bool, curves were formatted for upload
+
+LOCAL const char* const curveNames[TRACE_CURVES] = {"discharge", "open", "close"};
+
+/**
+ * start new curve
+ *
+ * @param curve enum TraceCurve
+ * @param duration [us] expected max. duration of curve
+ * @param voltage [mV] voltage at start of curve
+ */
+void ICACHE_FLASH_ATTR traceStart(uint8 curve, uint32 duration, uint16 voltage)
+{
+  current = &trace.curve[curve];
+  os_memset(current, 0, sizeof(TraceCurveT));
+  trace.curves &= ~(1 << curve);
+  interval = duration/TRACE_POINTS;
+  current->points[0].voltage = voltage;
+  current->count = 1;
+}
+
+/**
+ * add point to current curve if minimum interval since last point has passed
+ *
+ * @param elapsed [us] time since start of curve
+ * @param voltage [mV]
+ */
+void ICACHE_FLASH_ATTR traceSample(uint32 elapsed, uint16 voltage)
+{
+  if (current && current->count < TRACE_POINTS && elapsed >= current->count*interval)
+  {
+    TracePointT* point = &current->points[current->count++];
+    point->time = elapsed/32 < 0xFFFF? elapsed/32 : 0xFFFF;
+    point->voltage = voltage;
+  }
+}
+
+/**
+ * complete current curve and fit RC model
+ *
+ * @param asymptote [mV] final voltage of RC model
+ * @return time constant [us], 0 if not enough points for fit
+ */
+uint32 ICACHE_FLASH_ATTR traceFinish(uint16 asymptote)
+{
+  if (!current)
+  {
+    return 0;
+  }
+
+  uint16 initial = current->points[0].voltage;
+  bool rising = asymptote > initial;
+  uint64 sumTT = 0;
+  uint64 sumTY = 0;
+  for (uint8 i=1; i<current->count; i++)
+  {
+    uint16 voltage = current->points[i].voltage;
+    uint32 y; // Q16.16
+    if (rising)
+    {
+      if (voltage + TRACE_MIN_DELTA > asymptote || voltage <= initial)
+      {
+        continue;
+      }
+      y = fixLnRatio(asymptote - initial, asymptote - voltage);
+    }
+    else
+    {
+      if (voltage < asymptote + TRACE_MIN_DELTA || voltage >= initial)
+      {
+        continue;
+      }
+      y = fixLnRatio(initial - asymptote, voltage - asymptote);
+    }
+    uint32 t = current->points[i].time;
+    sumTT += t*t;
+    sumTY += (uint64)t*y;
+  }
+
+  // tau = sum(t*t)/sum(t*y), time unit 32 us
+  uint64 tau = sumTY? (32*(sumTT << 16) + sumTY/2)/sumTY : 0; // [us]
+  current->asymptote = asymptote;
+  current->tau = tau < 0xFFFFFFFF? tau : 0xFFFFFFFF;
+
+  uint8 curve = current - trace.curve;
+  trace.curves |= 1 << curve;
+  captured |= 1 << curve;
+  current = NULL;
+
+  return trace.curve[curve].tau;
+}
+
+/**
+ * save curves captured since boot to flash
+ */
+void ICACHE_FLASH_ATTR traceSave(SleeperStateT* sleeperState)
+{
+  if (!captured)
+  {
+    return;
+  }
+
+  uint32 sector = getUserDataSector(TRACE_FLASH_SECTOR);
+  trace.magic = TRACE_MAGIC;
+  trace.curves = captured;
+
+  // skip erasing flash if pending curves are unchanged
+  TraceT stored;
+  if (sleeperState->rtcMem.tracePending
+      && spi_flash_read(sector*SPI_FLASH_SEC_SIZE, (uint32*)&stored, sizeof(stored)) == SPI_FLASH_RESULT_OK
+      && os_memcmp(&stored, &trace, sizeof(trace)) == 0)
+  {
+    return;
+  }
+
+  if (spi_flash_erase_sector(sector) == SPI_FLASH_RESULT_OK
+      && spi_flash_write(sector*SPI_FLASH_SEC_SIZE, (uint32*)&trace, sizeof(trace)) == SPI_FLASH_RESULT_OK)
+  {
+    sleeperState->rtcMem.tracePending = true;
+  }
+  else
+  {
+    LOG_ERROR("ERROR: writing trace to flash failed\r\n");
+  }
+}
+
+/**
+ * format pending curves as JSON property
+ *
+ * @return number of characters written, 0 if no curves are pending or buffer is too small
+ */
+uint16 ICACHE_FLASH_ATTR traceFormat(SleeperStateT* sleeperState, char* buffer, uint16 size)
+{
+  // curves captured since boot take precedence over curves in flash
+  if (!captured)
+  {
+    if (!sleeperState->rtcMem.tracePending
+        || spi_flash_read(getUserDataSector(TRACE_FLASH_SECTOR)*SPI_FLASH_SEC_SIZE, (uint32*)&trace, sizeof(trace)) != SPI_FLASH_RESULT_OK
+        || trace.magic != TRACE_MAGIC)
+    {
+      return 0;
+    }
+  }
+
+  // worst case length: 30 + C*(70 + P*14)
+  if (size < 30 + TRACE_CURVES*(70 + TRACE_POINTS*14))
+  {
+    return 0;
+  }
+
+  uint16 capacitance = sleeperState->rtcMem.valveCapacitance? sleeperState->rtcMem.valveCapacitance : CAPACITANCE; // [uF]
+  char* p = buffer;
+  p += os_sprintf(p, ", \"trace\":{\"C\":%u", capacitance);
+  for (uint8 c=0; c<TRACE_CURVES; c++)
+  {
+    if (trace.curves & (1 << c))
+    {
+      TraceCurveT* curve = &trace.curve[c];
+      p += os_sprintf(p, ", \"%s\":{\"tau\":%lu, \"R\":%lu, \"t\":[", curveNames[c], curve->tau, (curve->tau + capacitance/2)/capacitance);
+      for (uint8 i=0; i<curve->count; i++)
+      {
+        p += os_sprintf(p, i? ",%lu" : "%lu", 32UL*curve->points[i].time);
+      }
+      p += os_sprintf(p, "], \"u\":[");
+      for (uint8 i=0; i<curve->count; i++)
+      {
+        p += os_sprintf(p, i? ",%u" : "%u", curve->points[i].voltage);
+      }
+      p += os_sprintf(p, "]}");
+    }
+  }
+  p += os_sprintf(p, "}");
+  formatted = true;
+
+  return p - buffer;
+}
+
+/**
+ * server replied, pending curves are discarded if they were part of the request
+ */
+void ICACHE_FLASH_ATTR traceUploaded(SleeperStateT* sleeperState)
+{
+  if (formatted)
+  {
+    sleeperState->rtcMem.tracePending = false;
+    captured = 0;
+    formatted = false;
+  }
+}
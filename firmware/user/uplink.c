@@ -50,18 +50,20 @@ LOCAL tConnState connState = TCP_DISCONNECTED;
 LOCAL char* txPayload;
 LOCAL char rxPayload[1024];
 LOCAL uint16 rxPayloadSize;
+LOCAL uint32 txRequestTime; // [us]
+LOCAL uint32 rxReplyTime;   // [us]
 
 LOCAL void ICACHE_FLASH_ATTR clientSentCallback(void *arg)
 {
   struct espconn *pespconn = arg;
   connState = TCP_SENT;
 
-  // ets_uart_printf("TCP sent\r\n");
+  // LOG_DEBUG("TCP sent\r\n");
 
   if (rxPayload[0])
   {
     // 2nd transmit complete, close connection
-    ets_uart_printf("TCP disconnecting ...\r\n");
+    LOG_INFO("TCP disconnecting ...\r\n");
     espconn_disconnect(pespconn);
   }
 }
@@ -70,11 +72,12 @@ LOCAL void ICACHE_FLASH_ATTR clientReceiveCallback(void *arg, char *pdata, unsig
 {
   struct espconn *pespconn = arg;
 
+  rxReplyTime = system_get_time();
   os_memcpy(rxPayload, pdata, len);
   rxPayloadSize = len;
   connState = TCP_RECEIVED;
 
-  // ets_uart_printf("TCP message received: %s\r\n", rxPayload);
+  // LOG_DEBUG("TCP message received: %s\r\n", rxPayload);
 
   // trigger receive processing
   comProcessing();
@@ -88,13 +91,14 @@ LOCAL void ICACHE_FLASH_ATTR clientConnectedCallback(void *arg)
   espconn_regist_sentcb(pespconn, clientSentCallback);
   espconn_regist_recvcb(pespconn, clientReceiveCallback);
 
+  txRequestTime = system_get_time();
   sint8 sentStatus = espconn_sent(pespconn, txPayload, os_strlen(txPayload));
   if (sentStatus == ESPCONN_OK) {
     connState = TCP_SENDING;
-    ets_uart_printf("TCP connected, sending request: %s\r\n", txPayload);
+    LOG_DEBUG("TCP connected, sending request: %s\r\n", txPayload);
   } else {
     connState = TCP_SEND_ERROR;
-    ets_uart_printf("ERROR: TCP send failed, disconnecting ...\r\n");
+    LOG_ERROR("ERROR: TCP send failed, disconnecting ...\r\n");
     espconn_disconnect(pespconn);
   }
 }
@@ -104,11 +108,11 @@ LOCAL void ICACHE_FLASH_ATTR clientDisconnectedCallback(void *arg)
   struct espconn *pespconn = arg;
   connState = TCP_DISCONNECTED;
 
-  ets_uart_printf("TCP connection terminated\r\n");
+  LOG_INFO("TCP connection terminated\r\n");
 
   if (pespconn == NULL)
   {
-    ets_uart_printf("ERROR: TCP connection is NULL!\r\n");
+    LOG_ERROR("ERROR: TCP connection is NULL!\r\n");
   }
 
   // trigger disconnect processing
@@ -122,7 +126,7 @@ LOCAL void ICACHE_FLASH_ATTR clientErrorCallback(void *arg, sint8 err)
 
   if (err != ESPCONN_OK)
   {
-    ets_uart_printf("ERROR: TCP connection error: %d\r\n", err);
+    LOG_ERROR("ERROR: TCP connection error: %d\r\n", err);
     if (pespconn != NULL)
     {
       // try to close connection anyway
@@ -131,23 +135,24 @@ LOCAL void ICACHE_FLASH_ATTR clientErrorCallback(void *arg, sint8 err)
   }
   else
   {
-    ets_uart_printf("ERROR: undefined TCP connection error\r\n");
+    LOG_ERROR("ERROR: undefined TCP connection error\r\n");
   }
 }
 
-void ICACHE_FLASH_ATTR uplink_sendRequest(char* remoteIP, uint16 remotePort, char* message)
+void ICACHE_FLASH_ATTR uplink_sendRequest(uint32 remoteIP, uint16 remotePort, char* message)
 {
   txPayload = message;
   rxPayload[0] = '\0';
   rxPayloadSize = 0;
+  txRequestTime = 0;
+  rxReplyTime = 0;
   connState = TCP_CONNECTING;
 
   // define TCP client connection
   connection.proto.tcp = &tcp;
   connection.type      = ESPCONN_TCP;
   connection.state     = ESPCONN_NONE;
-  uint32 ip = ipaddr_addr(remoteIP);
-  os_memcpy(connection.proto.tcp->remote_ip, &ip, 4);
+  os_memcpy(connection.proto.tcp->remote_ip, &remoteIP, 4);
   connection.proto.tcp->local_port  = espconn_port();
   connection.proto.tcp->remote_port = remotePort;
 
@@ -157,21 +162,21 @@ void ICACHE_FLASH_ATTR uplink_sendRequest(char* remoteIP, uint16 remotePort, cha
   espconn_regist_reconcb(&connection, clientErrorCallback);
 
   // connect (non blocking)
-  ets_uart_printf("TCP connecting to " IPSTR ":%d\r\n", IP2STR(connection.proto.tcp->remote_ip), connection.proto.tcp->remote_port);
+  LOG_INFO("TCP connecting to " IPSTR ":%d\r\n", IP2STR(connection.proto.tcp->remote_ip), connection.proto.tcp->remote_port);
   sint8 espcon_status = espconn_connect(&connection);
   switch (espcon_status)
   {
     case ESPCONN_OK:
-//      ets_uart_printf("TCP connnection created.\r\n");
+//      LOG_DEBUG("TCP connnection created.\r\n");
       break;
     case ESPCONN_RTE:
-      ets_uart_printf("ERROR: TCP connect - no route to host.\r\n");
+      LOG_ERROR("ERROR: TCP connect - no route to host.\r\n");
       break;
     case ESPCONN_TIMEOUT:
-      ets_uart_printf("ERROR: TCP connect - timeout\r\n");
+      LOG_ERROR("ERROR: TCP connect - timeout\r\n");
       break;
     default:
-      ets_uart_printf("ERROR: TCP connect - error %d\r\n", espcon_status);
+      LOG_ERROR("ERROR: TCP connect - error %d\r\n", espcon_status);
   }
 }
 
@@ -190,6 +195,16 @@ uint16 ICACHE_FLASH_ATTR uplink_getReplySize()
   return rxPayloadSize;
 }
 
+uint32 ICACHE_FLASH_ATTR uplink_getRequestTime()
+{
+  return txRequestTime;
+}
+
+uint32 ICACHE_FLASH_ATTR uplink_getReplyTime()
+{
+  return rxReplyTime;
+}
+
 void ICACHE_FLASH_ATTR uplink_sendMessage(char* message)
 {
   txPayload = message;
@@ -197,10 +212,10 @@ void ICACHE_FLASH_ATTR uplink_sendMessage(char* message)
   sint8 sentStatus = espconn_sent(&connection, txPayload, os_strlen(txPayload));
   if (sentStatus == ESPCONN_OK) {
     connState = TCP_SENDING;
-    ets_uart_printf("TCP sending message: %s\r\n", txPayload);
+    LOG_DEBUG("TCP sending message: %s\r\n", txPayload);
   } else {
     connState = TCP_SEND_ERROR;
-    ets_uart_printf("ERROR: TCP send failed, disconnecting ...\r\n");
+    LOG_ERROR("ERROR: TCP send failed, disconnecting ...\r\n");
     espconn_disconnect(&connection);
   }
 }
@@ -215,7 +230,7 @@ void ICACHE_FLASH_ATTR uplink_close()
 {
   if (!uplink_isClosed())
   {
-    ets_uart_printf("TCP disconnecting ...\r\n");
+    LOG_INFO("TCP disconnecting ...\r\n");
     espconn_disconnect(&connection);
   }
 }
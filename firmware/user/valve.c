@@ -1,6 +1,6 @@
 /*****************************************************************************
  *
- * Copyright (c) 2015-2019 jnsbyr
+ * Copyright (c) 2015-2026 jnsbyr
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -26,13 +26,13 @@
 
 #include "valve.h"
 
-#include <math.h>
 #include <eagle_soc.h>
 #include <gpio.h>
 #include <osapi.h>
+#include <version.h>
 
-#include "adc.h"
 #include "esp_time.h"
+#include "valve_driver.h"
 
 // time tolerance for scheduling next activity
 #define SCHEDULE_TIME_TOLERANCE (SLEEPER_MIN_DOWNTIME + SLEEPER_COMMANDTIME)  // milliseconds
@@ -50,191 +50,144 @@ typedef struct
 LOCAL struct ets_tm tms;
 LOCAL OperationT valveTiming;
 
+// valve operations are sequenced asynchronously in timer context
+#define VALVE_QUEUE_SIZE (2*MAX_VALVES + 1)
 
-#if VALVE_DRIVER_TYPE == 1
+enum ValveOperation {VALVE_OPERATION_OPEN      = 1,
+                     VALVE_OPERATION_CLOSE     = 2,
+                     VALVE_OPERATION_PREPARE   = 3};
 
-// open Gardena latching valve using a 9 V step up converter and a capacitor
-//
-// GPIO  4 close valve         (push/pull, active high, floating in deep sleep)
-// GPIO  5 open valve          (open collector, active low, floating in deep sleep)
-// GPIO 13 charge capacitor    (open collector, active low)
-// GPIO 15 power supply enable (push/pull, active high, pulldown)
-
-// close valve output
-#define CLOSE_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO4_U
-#define CLOSE_VALVE_GPIO_FUNC FUNC_GPIO4
-#define CLOSE_VALVE_GPIO 4
-
-// open valve output works inverted!
-#define OPEN_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO5_U
-#define OPEN_VALVE_GPIO_FUNC FUNC_GPIO5
-#define OPEN_VALVE_GPIO 5
-
-// recharging capacitor output works inverted!
-#define CAPACITOR_GPIO_MUX PERIPHS_IO_MUX_MTCK_U
-#define CAPACITOR_GPIO_FUNC FUNC_GPIO13
-#define CAPACITOR_GPIO 13
-
-// enable generator output
-#define GENERATOR_GPIO_MUX PERIPHS_IO_MUX_MTDO_U
-#define GENERATOR_GPIO_FUNC FUNC_GPIO15
-#define GENERATOR_GPIO 15
+LOCAL os_timer_t valveTimer;
+LOCAL SleeperStateT* valveState;
+LOCAL uint8 valveQueue[VALVE_QUEUE_SIZE]; // operation | valve index << 4
+LOCAL uint8 valveQueueCount;
+LOCAL uint8 valveOperation; // operation in progress, 0 = idle
+LOCAL const ValveDriverT* const drivers[] = {&capacitorDriver, &hbridgeDriver, &simulatedDriver}; // @see enum ValveDriverType
+LOCAL const ValveDriverT* driver;
+
+LOCAL uint8 valveIndex;            // valve controlled by schedule
+LOCAL ValveStateT* valve;          // valve controlled by schedule
+LOCAL uint8 operatedIndex;         // valve operated by driver
+LOCAL ValveStateT* operatedValve;  // valve operated by driver
+
+LOCAL void ICACHE_FLASH_ATTR valveQueueOperation(SleeperStateT* sleeperState, uint8 operation);
 
 /**
- * called first at OS init
+ * select valve controlled by schedule
  */
-void ICACHE_FLASH_ATTR valveDriverInit()
+LOCAL void ICACHE_FLASH_ATTR setValve(SleeperStateT* sleeperState, uint8 index)
 {
-  // configure GPIO outputs
-  PIN_FUNC_SELECT(GENERATOR_GPIO_MUX,   GENERATOR_GPIO_FUNC);
-  PIN_FUNC_SELECT(OPEN_VALVE_GPIO_MUX,  OPEN_VALVE_GPIO_FUNC);
-  PIN_FUNC_SELECT(CLOSE_VALVE_GPIO_MUX, CLOSE_VALVE_GPIO_FUNC);
-  PIN_FUNC_SELECT(CAPACITOR_GPIO_MUX,   CAPACITOR_GPIO_FUNC);
-
-  // configure passive output state
-  GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
-  GPIO_DIS_OUTPUT(OPEN_VALVE_GPIO);
-  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 0);
-  GPIO_DIS_OUTPUT(CAPACITOR_GPIO);
+  valveIndex = index;
+  valve = &sleeperState->rtcMem.valves[index];
 }
 
-LOCAL void ICACHE_FLASH_ATTR valveClose(SleeperStateT* sleeperState);
+#if MAX_VALVES > 4
+#error "MAX_VALVES is limited to 4 by the number of valve select outputs"
+#elif MAX_VALVES > 1
+
+// multiplexed valve drivers
+//
+// GPIO  0 valve select bit 0 (push/pull, boot mode pin, must not be pulled low externally)
+// GPIO  2 valve select bit 1 (push/pull, boot mode pin, must not be pulled low externally)
+
+#define VALVE_SELECT_0_GPIO_MUX PERIPHS_IO_MUX_GPIO0_U
+#define VALVE_SELECT_0_GPIO_FUNC FUNC_GPIO0
+#define VALVE_SELECT_0_GPIO 0
+
+#define VALVE_SELECT_1_GPIO_MUX PERIPHS_IO_MUX_GPIO2_U
+#define VALVE_SELECT_1_GPIO_FUNC FUNC_GPIO2
+#define VALVE_SELECT_1_GPIO 2
 
 /**
- * open valve
+ * configure valve select outputs
  */
-LOCAL void ICACHE_FLASH_ATTR valveOpen(SleeperStateT* sleeperState)
+LOCAL void ICACHE_FLASH_ATTR valveSelectInit()
 {
-  // discharge capacitor as much as possible while powering up generator (this may also close valve if still open)
-  uint16 initialVoltage = adcRead(); // [mV]
-  uint32 t0 = system_get_time(); // [us]
-  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 1);
-
-  // start generator
-  GPIO_OUTPUT_SET(GENERATOR_GPIO, 1);
-
-  // monitor capacitor discharge, typically no discharging required
-  //
-  // notes:
-  // (1) discharging will fail if valve is not properly connected
-  // (2) full discharge not possible because MOSFET to 9V is not completely closed
-  //
-  uint16 dischargedVoltage = initialVoltage;
-  uint16 requiredVoltage = MAX_DISCHARGE_VOLTAGE_2; // [mV]
-  bool dischargeTimeout = false;
-  uint32 t1 = t0; // [us]
-  if (initialVoltage > requiredVoltage)
-  {
-    // estimate max. discharge time (valve + resistor)
-    uint32 timeout = round(-RC_CONSTANT*1.2f*log((float)requiredVoltage/initialVoltage)*1000000); // [us]
-    ets_uart_printf("valve: discharge timeout %lu us\r\n", timeout);
-    if (timeout > MAX_DISCHARGE_TIMEOUT)
-    {
-      timeout = MAX_DISCHARGE_TIMEOUT;
-    }
+  PIN_FUNC_SELECT(VALVE_SELECT_0_GPIO_MUX, VALVE_SELECT_0_GPIO_FUNC);
+  PIN_FUNC_SELECT(VALVE_SELECT_1_GPIO_MUX, VALVE_SELECT_1_GPIO_FUNC);
+  GPIO_OUTPUT_SET(VALVE_SELECT_0_GPIO, 0);
+  GPIO_OUTPUT_SET(VALVE_SELECT_1_GPIO, 0);
+}
 
-    // check voltage every few milliseconds
-    bool discharged;
-    uint32 duration;
-    do
-    {
-      os_delay_us(250); // [us]
-      dischargedVoltage = adcRead(); // [mV]
-      t1 = system_get_time(); // [us]
-      discharged = dischargedVoltage <= requiredVoltage;
-      duration = t1 - t0;
-      dischargeTimeout = !discharged && (duration >= timeout);
-    } while (!dischargeTimeout && !discharged);
-    if (duration >= 1000000) {
-      // soft WDT timeout is 3.2 s, but just in case ...
-      system_soft_wdt_feed();
-    }
-    ets_uart_printf("valve: discharged %u -> %u mV in %lu us\r\n", initialVoltage, dischargedVoltage, duration);
+/**
+ * connect valve driver to valve
+ */
+LOCAL void ICACHE_FLASH_ATTR valveSelect(uint8 index)
+{
+  GPIO_OUTPUT_SET(VALVE_SELECT_0_GPIO, index & 1);
+  GPIO_OUTPUT_SET(VALVE_SELECT_1_GPIO, (index >> 1) & 1);
+}
+
+#endif
+
+
+/**
+ * check end of driver phase, waits for exact end if it is less than VALVE_BUSY_WAIT away
+ *
+ * @param start [us]
+ * @param duration [us]
+ */
+uint8 ICACHE_FLASH_ATTR valvePhaseElapsed(uint32 start, uint32 duration)
+{
+  uint32 elapsed = system_get_time() - start; // [us]
+  if (elapsed + VALVE_BUSY_WAIT < duration)
+  {
+    return false;
   }
-  else
+  if (elapsed < duration)
   {
-    ets_uart_printf("valve: no discharge needed at %u mV\r\n", initialVoltage);
+    os_delay_us(duration - elapsed);
   }
-
-  // stop discharging capacitor
-  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 0);
-
-  if (!dischargeTimeout)
+  else if (elapsed > duration)
   {
-    // open latching valve by charing capacitor
-    dischargedVoltage = adcRead(); // [mV]
-    t0 = system_get_time(); // [us]
-    GPIO_OUTPUT_SET(OPEN_VALVE_GPIO, 0);
+    // timer callback was delayed by more than one period, phase ends now
+    LOG_WARNING("WARNING: valve phase late %lu us\r\n", elapsed - duration);
+  }
+  return true;
+}
 
-    // check voltage every few milliseconds
-    uint16 supplyVolage = sleeperState->rtcMem.valveSupplyVoltage > NOMINAL_SUPPLY_VOLTAGE && sleeperState->rtcMem.valveSupplyVoltage < MAX_VALID_SUPPLY_VOLTAGE? sleeperState->rtcMem.valveSupplyVoltage : TYPICAL_SUPPLY_VOLTAGE; // [mV]
-    uint16 chargedVoltage = dischargedVoltage;
-    uint32 timeout = VALVE_OPEN_PULSE_DURATION; // max. 250 ms (Gardena valve timing)
-    uint16 resistance = 0; // [ohm]
-    uint32 duration;
-    do
-    {
-      os_delay_us(250); // [us]
-      chargedVoltage = adcRead();
-      duration = system_get_time() - t0; // [mV]
-      if (chargedVoltage > supplyVolage && chargedVoltage < MAX_VALID_SUPPLY_VOLTAGE)
-      {
-        // update supply voltage (find maximum)
-        supplyVolage = chargedVoltage;
-        sleeperState->rtcMem.valveSupplyVoltage = supplyVolage;
-      }
-      if (!resistance && chargedVoltage >= NOMINAL_SUPPLY_VOLTAGE && chargedVoltage < supplyVolage)
-      {
-        // resistance when charged to nominal supply voltage
-        resistance = round(-0.000001f*duration/CAPACITANCE/log(1.0f - (float)chargedVoltage/supplyVolage)); // [ohm]
-        ets_uart_printf("valve: resistance %u ohm after %lu us\r\n", resistance, duration);
-      }
-    } while (duration < timeout);
-    ets_uart_printf("valve: charged %u -> %u mV @ %s in %lu us\r\n", dischargedVoltage, chargedVoltage, supplyVolage, duration);
+/**
+ * select valve driver of board, called first at OS init
+ */
+void ICACHE_FLASH_ATTR valveDriverInit()
+{
+  driver = drivers[VALVE_DRIVER_TYPE - 1];
+  driver->init();
+#if MAX_VALVES > 1
+  valveSelectInit();
+#endif
+}
 
-    // disable power to valve and disable generator
-    GPIO_DIS_OUTPUT(OPEN_VALVE_GPIO);
-    GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
+/**
+ * @return firmware version suffix of selected valve driver
+ */
+char ICACHE_FLASH_ATTR valveGetDriverId()
+{
+  return driver->id;
+}
 
-    // update state
-    if (!sleeperState->rtcMem.valveOpen)
-    {
-      sleeperState->rtcMem.valveOpen = true;
-      sleeperState->rtcMem.totalOpenCount++;
-    }
-    sleeperState->rtcMem.valveOpenTime = sleeperState->now;
-    sleeperState->rtcMem.valveResistance = resistance;
-
-    // check capacitor voltage and valve resistance
-    ets_uart_printf("valve: open %u mV\r\n", chargedVoltage);
-    if (resistance > 0 && (resistance < MIN_RESISTANCE
-                       || (sleeperState->rtcMem.maxValveResistance >  0 && resistance > sleeperState->rtcMem.maxValveResistance)
-                       || (sleeperState->rtcMem.maxValveResistance <= 0 && resistance > MAX_RESISTANCE)))
-    {
-      ets_uart_printf("valve: may be open (bad wiring), trying to close ...\r\n");
-      sleeperState->rtcMem.lastValveOperationStatus = VALVE_STATUS_BAD_WIRING;
-      valveClose(sleeperState);
-    }
-    else if (chargedVoltage >= supplyVolage - CHARGING_VOLTAGE_TOLERANCE)
-    {
-      ets_uart_printf("valve: opened\r\n");
-      sleeperState->rtcMem.lastValveOperationStatus = VALVE_STATUS_OK;
-    }
-    else
-    {
-      ets_uart_printf("valve: may be open (low battery or bad wiring), trying to close ...\r\n");
-      sleeperState->rtcMem.lastValveOperationStatus = VALVE_STATUS_LOW_OPEN_VOLTAGE;
-      valveClose(sleeperState);
-    }
-  }
-  else
-  {
-    // discharging failed, disable generator
-    GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
+/**
+ * called last before OS shutdown
+ */
+void ICACHE_FLASH_ATTR valveDriverShutdown()
+{
+  driver->shutdown();
+}
 
-    ets_uart_printf("valve: not opened (bad wiring)\r\n");
-    sleeperState->rtcMem.lastValveOperationStatus = VALVE_STATUS_BAD_WIRING;
+/**
+ * open valve
+ */
+LOCAL void ICACHE_FLASH_ATTR valveOpen(SleeperStateT* sleeperState)
+{
+  // update state, reverted by driver if valve could not be operated
+  if (!valve->open)
+  {
+    valve->open = true;
+    valve->openCount++;
   }
+  valve->openTime = sleeperState->now;
+
+  valveQueueOperation(sleeperState, VALVE_OPERATION_OPEN);
 }
 
 /**
@@ -242,233 +195,219 @@ LOCAL void ICACHE_FLASH_ATTR valveOpen(SleeperStateT* sleeperState)
  */
 LOCAL void ICACHE_FLASH_ATTR valveClose(SleeperStateT* sleeperState)
 {
-  // start generator
-  GPIO_OUTPUT_SET(GENERATOR_GPIO, 1);
-  os_delay_us(1000); // 1 ms -> us
-
-  // recharge capacitor while bypassing valve
-  GPIO_OUTPUT_SET(CAPACITOR_GPIO, 0);
-  uint16 initialVoltage = adcRead(); // [mV]
-  uint32 t0 = system_get_time();
-  uint16 chargedVoltage = initialVoltage;
-  bool detectSupplyVoltage = sleeperState->rtcMem.valveSupplyVoltage < NOMINAL_SUPPLY_VOLTAGE || sleeperState->rtcMem.valveSupplyVoltage > MAX_VALID_SUPPLY_VOLTAGE;
-  uint16 requiredVoltage = !detectSupplyVoltage? NOMINAL_SUPPLY_VOLTAGE : MAX_VALID_SUPPLY_VOLTAGE; // [mV] - 9.25 V are typically reached after about 84 ms with R = 18 ohm
-  uint32 timeout = !detectSupplyVoltage? RECHARGE_TIMEOUT : 2*RECHARGE_TIMEOUT; // [us]
-  uint32 duration;
-  bool chargeTimeout = false;
-  if (initialVoltage < requiredVoltage)
-  {
-    // check again every 2 ms
-    uint16 supplyVolage = sleeperState->rtcMem.valveSupplyVoltage > NOMINAL_SUPPLY_VOLTAGE && sleeperState->rtcMem.valveSupplyVoltage < MAX_VALID_SUPPLY_VOLTAGE? sleeperState->rtcMem.valveSupplyVoltage : TYPICAL_SUPPLY_VOLTAGE; // [mV]
-    uint16 resistance = 0; // [ohm]
-    bool charged;
-    do
-    {
-      os_delay_us(250); // [us]
-      chargedVoltage = adcRead(); // [mV]
-      duration = system_get_time() - t0; // [us]
-      charged = !detectSupplyVoltage && chargedVoltage > requiredVoltage;
-      chargeTimeout = !charged && (duration >= timeout); // [us]
-      //if (!resistance && chargedVoltage > NOMINAL_SUPPLY_VOLTAGE && chargedVoltage < supplyVolage)
-      //{
-      //  // RC partial charge
-      //  resistance = round(-0.000001f*duration/CAPACITANCE/log((1.0f - (float)chargedVoltage/supplyVolage))/(1.0f - (float)initialVoltage/supplyVolage)); // [ohm]
-      //  ets_uart_printf("valve: resistance %u ohm after %lu us\r\n", resistance, duration);
-      //}
-      //if (chargedVoltage >= 8500)
-      //{
-      //  ets_uart_printf("valve: %u mV %lu us\r\n", chargedVoltage, duration);
-      //}
-    } while (!chargeTimeout && !charged);
-    ets_uart_printf("valve: charged %u -> %u mV in %lu us\r\n", initialVoltage, chargedVoltage, duration);
+  // update state
+  valve->open = false;
+  if (sleeperState->now > valve->openTime)
+  {
+    valve->openDuration += (sleeperState->now - valve->openTime)/1000;
   }
-  else
+
+  valveQueueOperation(sleeperState, VALVE_OPERATION_CLOSE);
+}
+
+/**
+ * driver completed valve operation
+ */
+LOCAL void ICACHE_FLASH_ATTR valveCompleted()
+{
+  uint8 operation = valveOperation;
+  valveOperation = 0;
+
+  if (operation == VALVE_OPERATION_OPEN && operatedValve->open && operatedValve->status != VALVE_STATUS_OK)
   {
-    ets_uart_printf("valve: no charging needed at %u mV\r\n", initialVoltage);
+    // valve may be partially open, try to close
+    setValve(valveState, operatedIndex);
+    valveClose(valveState);
   }
+}
 
-  // detect valve driver supply voltage
-  if (detectSupplyVoltage)
+/**
+ * start queued valve operations until one is in progress
+ */
+LOCAL void ICACHE_FLASH_ATTR valveNext()
+{
+  while (valveOperation == 0 && valveQueueCount)
   {
-    if (chargedVoltage > NOMINAL_SUPPLY_VOLTAGE && chargedVoltage < MAX_VALID_SUPPLY_VOLTAGE)
+    uint8 operation = valveQueue[0];
+    valveQueueCount--;
+    os_memmove(valveQueue, valveQueue + 1, valveQueueCount);
+    operatedIndex = operation >> 4;
+    operatedValve = &valveState->rtcMem.valves[operatedIndex];
+#if MAX_VALVES > 1
+    valveSelect(operatedIndex);
+#endif
+    uint8 busy;
+    valveOperation = operation & 0x0F;
+    switch (valveOperation)
     {
-      // init supply voltage
-      sleeperState->rtcMem.valveSupplyVoltage = chargedVoltage;
-      ets_uart_printf("valve: supply voltage %u mV\r\n", chargedVoltage);
-      chargeTimeout = false;
+      case VALVE_OPERATION_OPEN:  busy = driver->open(valveState, operatedValve);    break;
+      case VALVE_OPERATION_CLOSE: busy = driver->close(valveState, operatedValve);   break;
+      default:                    busy = driver->prepare(valveState, operatedValve);
     }
-    else
+    if (!busy)
     {
-      ets_uart_printf("valve: supply voltage out of valid range (%u mV)\r\n", chargedVoltage);
+      valveCompleted();
     }
   }
+}
 
-  // stop capacitor charging and disable generator
-  GPIO_DIS_OUTPUT(CAPACITOR_GPIO);
-  os_delay_us(20); // 20 us
-  GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
-
-  // close latching valve by discharging capacitor
-  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 1);
-  os_delay_us(VALVE_CLOSE_PULSE_DURATION); // 62.5 ms -> us (Gardena valve timing)
-  // keep CLOSE_VALVE_GPIO set to continue discharging capacitor until os shutdown
-
-  // update state
-  sleeperState->rtcMem.valveOpen = false;
-  if (sleeperState->now > sleeperState->rtcMem.valveOpenTime)
+/**
+ * continue valve operation in progress
+ */
+LOCAL void ICACHE_FLASH_ATTR valveStep()
+{
+  if (valveOperation && !driver->step(valveState))
   {
-    sleeperState->rtcMem.totalOpenDuration += (sleeperState->now - sleeperState->rtcMem.valveOpenTime)/1000;
+    valveCompleted();
   }
+}
 
-  uint16 closeVoltage = adcRead();
-  ets_uart_printf("valve: close %u mV\r\n", closeVoltage);
-  if (chargeTimeout)
+/**
+ * valve operation processing
+ */
+LOCAL void ICACHE_FLASH_ATTR valveTimerCallback(void *arg)
+{
+  valveStep();
+  valveNext();
+  if (valveOperation == 0)
   {
-    ets_uart_printf("valve: probably not closed (low battery)\r\n");
-    sleeperState->rtcMem.lastValveOperationStatus = VALVE_STATUS_LOW_CLOSE_VOLTAGE;
+    os_timer_disarm(&valveTimer);
   }
-  else if (closeVoltage >= MAX_DISCHARGE_VOLTAGE_1) // [mV] - full discharge not possible in 62.5 ms (and not required for operating valve)
+}
+
+/**
+ * queue valve operation and start processing in timer context
+ */
+LOCAL void ICACHE_FLASH_ATTR valveQueueOperation(SleeperStateT* sleeperState, uint8 operation)
+{
+  if (valveQueueCount >= VALVE_QUEUE_SIZE)
   {
-    ets_uart_printf("valve: probably not closed (bad wiring)\r\n");
-    sleeperState->rtcMem.lastValveOperationStatus = VALVE_STATUS_BAD_WIRING;
+    LOG_ERROR("ERROR: valve operation queue full\r\n");
+    return;
   }
-  else
+
+  valveState = sleeperState;
+  valveQueue[valveQueueCount++] = operation | (valveIndex << 4);
+  if (valveOperation == 0)
   {
-    ets_uart_printf("valve: closed\r\n");
-    // @todo only set OK status when opening?
-    sleeperState->rtcMem.lastValveOperationStatus = VALVE_STATUS_OK;
+    valveNext();
+    if (valveOperation != 0)
+    {
+      os_timer_disarm(&valveTimer);
+      os_timer_setfn(&valveTimer, (os_timer_func_t*) valveTimerCallback, NULL);
+#if defined(ESP_SDK_VERSION_NUMBER) && (ESP_SDK_VERSION_NUMBER >= 2)
+      os_timer_arm(&valveTimer, VALVE_TIMER_PERIOD, true);
+#else
+      os_timer_arm(&valveTimer, VALVE_TIMER_PERIOD, 1);
+#endif
+    }
   }
 }
 
 /**
- * called last before OS shutdown
+ * @return true if valve operation is in progress or pending
  */
-void ICACHE_FLASH_ATTR valveDriverShutdown()
+uint8 ICACHE_FLASH_ATTR valveIsBusy()
 {
-  // stop discharging capacitor (and possibly closing valve)
-  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 0);
+  return valveOperation != 0 || valveQueueCount > 0;
 }
 
-#elif VALVE_DRIVER_TYPE == 2
-
-// GPIO  4 valve direction select (push/pull, active high, floating in deep sleep)
-// GPIO  5 operate valve          (push/pull, active high, floating in deep sleep)
-// GPIO 15 power supply enable    (push/pull, active high, pulldown)
-
-// close valve output
-#define OPEN_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO4_U
-#define OPEN_VALVE_GPIO_FUNC FUNC_GPIO4
-#define OPEN_VALVE_GPIO 4
-
-// open valve output works inverted!
-#define OPERATE_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO5_U
-#define OPERATE_VALVE_GPIO_FUNC FUNC_GPIO5
-#define OPERATE_VALVE_GPIO 5
-
-// enable generator output
-#define GENERATOR_GPIO_MUX PERIPHS_IO_MUX_MTDO_U
-#define GENERATOR_GPIO_FUNC FUNC_GPIO15
-#define GENERATOR_GPIO 15
-
 /**
- * called first at OS init
+ * complete pending valve operations synchronously
  */
-void ICACHE_FLASH_ATTR valveDriverInit()
+void ICACHE_FLASH_ATTR valveFinish()
 {
-  // configure GPIO outputs and passive output state
-  PIN_FUNC_SELECT(GENERATOR_GPIO_MUX,     GENERATOR_GPIO_FUNC);
-  GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
-
-  PIN_FUNC_SELECT(OPERATE_VALVE_GPIO_MUX, OPERATE_VALVE_GPIO_FUNC);
-  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 0);
-
-  PIN_FUNC_SELECT(OPEN_VALVE_GPIO_MUX,    OPEN_VALVE_GPIO_FUNC);
-  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO, 0);
+  while (valveIsBusy())
+  {
+    os_delay_us(250); // [us]
+    valveStep();
+    valveNext();
+    system_soft_wdt_feed();
+  }
+  os_timer_disarm(&valveTimer);
 }
 
 /**
- * open valve
+ * prepare valve driver while WLAN is connecting if valve will probably be closed in this wake cycle
  */
-LOCAL void ICACHE_FLASH_ATTR valveOpen(SleeperStateT* sleeperState)
+void ICACHE_FLASH_ATTR valvePrepare(SleeperStateT* sleeperState)
 {
-  // start generator, preset valve direction to open and wait for generator voltage to stablelize
-  GPIO_OUTPUT_SET(GENERATOR_GPIO,  1);
-  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO, 0);  // 0 -> VOUT1 = H
-  os_delay_us(5000); // 5 ms -> us
-
-  // open valve by enabling H-bridge
-  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 1);
-  os_delay_us(VALVE_OPEN_PULSE_DURATION); // (250 ms) -> us
-
-  // short circuit valve current
-  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 0);
-  os_delay_us(1000); // 1 ms -> us
-
-  // done, go to passive state
-  valveDriverShutdown();
-
-  // update state
-  if (!sleeperState->rtcMem.valveOpen)
+  for (uint8 i=0; i<MAX_VALVES && driver->prepare; i++)
   {
-    sleeperState->rtcMem.valveOpen = true;
-    sleeperState->rtcMem.totalOpenCount++;
+    ValveStateT* v = &sleeperState->rtcMem.valves[i];
+    if (!sleeperState->rtcMem.lowBattery && v->open && !valveIsBusy() &&
+        v->closeTime <= sleeperState->now + MAX_WLAN_TIME)
+    {
+      // e.g. pre-charge capacitor so that valve can be closed immediately when requested
+      LOG_INFO("valve: close due, preparing\r\n");
+      setValve(sleeperState, i);
+      valveQueueOperation(sleeperState, VALVE_OPERATION_PREPARE);
+    }
   }
-  sleeperState->rtcMem.valveOpenTime = now;
-  ets_uart_printf("valveOpen\r\n");
 }
 
 /**
- * close valve
+ * @return true if any valve is open
  */
-LOCAL void ICACHE_FLASH_ATTR valveClose(SleeperStateT* sleeperState)
+uint8 ICACHE_FLASH_ATTR valveIsAnyOpen(SleeperStateT* sleeperState)
 {
-  // start generator, preset valve direction to close and wait for generator voltage to stablelize
-  GPIO_OUTPUT_SET(GENERATOR_GPIO,  1);
-  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO, 1); // 1 -> VOUT2 = H
-  os_delay_us(5000); // 5 ms -> us
-
-  // close valve by enabling H-bridge
-  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 1);
-  os_delay_us(VALVE_CLOSE_PULSE_DURATION); // 62.5 ms -> us
-
-  // short circuit valve current
-  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 0);
-  os_delay_us(1000); // 1 ms -> us
-
-  // done, go to passive state
-  valveDriverShutdown();
-
-  // update state
-  sleeperState->rtcMem.valveOpen = false;
-  if (now > sleeperState->rtcMem.valveOpenTime)
+  for (uint8 i=0; i<MAX_VALVES; i++)
   {
-    sleeperState->rtcMem.totalOpenDuration += (now - sleeperState->rtcMem.valveOpenTime)/1000;
+    if (sleeperState->rtcMem.valves[i].open)
+    {
+      return true;
+    }
   }
-  ets_uart_printf("valveClose\r\n");
+  return false;
 }
 
 /**
- * called last before OS shutdown
+ * @return status of last operation of 1st valve with failed operation or VALVE_STATUS_OK
  */
-void ICACHE_FLASH_ATTR valveDriverShutdown()
+uint8 ICACHE_FLASH_ATTR valveGetStatus(SleeperStateT* sleeperState)
 {
-  // passive GPIO output state
-  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 0);
-  GPIO_OUTPUT_SET(GENERATOR_GPIO,     0);
-  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO,    0);
+  for (uint8 i=0; i<MAX_VALVES; i++)
+  {
+    if (sleeperState->rtcMem.valves[i].status != VALVE_STATUS_OK)
+    {
+      return sleeperState->rtcMem.valves[i].status;
+    }
+  }
+  return VALVE_STATUS_OK;
 }
 
-#else
+#if MAX_VALVES > 1
+/**
+ * add state of all valves as JSON property
+ *
+ * @return number of characters written
+ */
+uint16 ICACHE_FLASH_ATTR valveFormat(SleeperStateT* sleeperState, char* buffer, uint16 size)
+{
+  // max. 92 characters per valve
+  if (size < 16 + 92*MAX_VALVES)
+  {
+    return 0;
+  }
 
-#error "selected VALVE_DRIVER_TYPE is not supported, choose 1 (capacitor) or 2 (H-bridge)"
+  uint16 length = os_sprintf(buffer, ", \"valves\":[");
+  for (uint8 i=0; i<MAX_VALVES; i++)
+  {
+    ValveStateT* v = &sleeperState->rtcMem.valves[i];
+    length += os_sprintf(buffer + length, "%s{\"state\":\"%s\", \"status\":%u, \"opened\":%u, \"totalOpen\":%lu, \"resistance\":%u}",
+                         i? ", " : "", v->open? "ON" : "OFF", v->status, v->openCount, v->openDuration, v->resistance);
+  }
+  length += os_sprintf(buffer + length, "]");
 
-#endif // VALVE_DRIVER_TYPE
+  return length;
+}
+#endif
 
 
 /**
  * find index of 1st scheduled activity that matches current time (tms)
  *
- * @todo will not find current activity that runs over midnight GMT after day has changed
+ * @todo will not find current activity that runs over local midnight after day has changed
  *
  * @return -1 if not found
  */
@@ -484,8 +423,9 @@ LOCAL int ICACHE_FLASH_ATTR getCurrentActivity(SleeperStateT* sleeperState)
       // found 1st invalid activity, done
       break;
     }
-    else if (activity->day == DAY_EVERY || (activity->day == DAY_SECOND && tms.tm_yday%2 == 0) ||
-             (activity->day == DAY_THIRD && tms.tm_yday%3 == 0) || (activity->day - DAY_SUNDAY) == tms.tm_wday)
+    else if (activity->valve == valveIndex &&
+             (activity->day == DAY_EVERY || (activity->day == DAY_SECOND && tms.tm_yday%2 == 0) ||
+              (activity->day == DAY_THIRD && tms.tm_yday%3 == 0) || (activity->day - DAY_SUNDAY) == tms.tm_wday))
     {
       // found activity for today
       if (minuteOfDay >= activity->startTime && secondOfDay <= (60*activity->startTime + effectiveDuration(activity->duration)))
@@ -530,7 +470,7 @@ LOCAL uint8 ICACHE_FLASH_ATTR calculateValveTiming(SleeperStateT* sleeperState,
         tms.tm_sec  = 0;
         tms.tm_msec = 0;
         valveTiming.duration = 1000UL*effectiveDuration(activity->duration);
-        valveTiming.start    = esp_mktime(&tms);
+        valveTiming.start    = esp_mklocaltime(&tms, &sleeperState->rtcMem.timeZone);
         valveTiming.end      = valveTiming.start + valveTiming.duration;
       }
       break;
@@ -572,6 +512,23 @@ LOCAL uint64 ICACHE_FLASH_ATTR getOverrideEndTime(SleeperStateT* sleeperState, u
   return overrideEndTime;
 }
 
+/**
+ * convert local start time of activity today or on one of the next days to UTC, considering DST changes
+ *
+ * @param days days after today
+ * @param startTime minutes since local midnight
+ */
+LOCAL uint64 ICACHE_FLASH_ATTR getLocalStartTime(SleeperStateT* sleeperState, uint8 days, uint16 startTime)
+{
+  struct ets_tm start = tms;
+  start.tm_mday += days; // esp_mktime is linear in day of month
+  start.tm_hour  = startTime/60;
+  start.tm_min   = startTime%60;
+  start.tm_sec   = 0;
+  start.tm_msec  = 0;
+  return esp_mklocaltime(&start, &sleeperState->rtcMem.timeZone);
+}
+
 /**
  * get start time of next scheduled activity
  * @return 0 if not found
@@ -583,14 +540,15 @@ LOCAL uint64 ICACHE_FLASH_ATTR getNextActivityStart(SleeperStateT* sleeperState)
   for (int i=0; i<MAX_ACTIVITIES; i++)
   {
     ActivityT* activity = &sleeperState->rtcMem.activities[i];
-    //ets_uart_printf("getNextActivityStart: A checking next day %u minute %u: day %u minute %u\r\n", tms.tm_wday, minuteOfDay, activity->day, activity->startTime);
+    //LOG_DEBUG("getNextActivityStart: A checking next day %u minute %u: day %u minute %u\r\n", tms.tm_wday, minuteOfDay, activity->day, activity->startTime);
     if (activity->day == DAY_INVALID)
     {
       // found 1st invalid activity, done
       break;
     }
-    else if (activity->day == DAY_EVERY || (activity->day == DAY_SECOND && tms.tm_yday%2 == 0) ||
-             (activity->day == DAY_THIRD && tms.tm_yday%3 == 0) || (activity->day - DAY_SUNDAY) == tms.tm_wday)
+    else if (activity->valve == valveIndex &&
+             (activity->day == DAY_EVERY || (activity->day == DAY_SECOND && tms.tm_yday%2 == 0) ||
+              (activity->day == DAY_THIRD && tms.tm_yday%3 == 0) || (activity->day - DAY_SUNDAY) == tms.tm_wday))
     {
       // found activity for today
       if (minuteOfDay < activity->startTime)
@@ -600,7 +558,7 @@ LOCAL uint64 ICACHE_FLASH_ATTR getNextActivityStart(SleeperStateT* sleeperState)
         if (delta < minutesTillStart)
         {
           // found activity that starts earlier
-          //ets_uart_printf("getNextActivityStart: A checking next: %u minutes\r\n", delta);
+          //LOG_DEBUG("getNextActivityStart: A checking next: %u minutes\r\n", delta);
           minutesTillStart = delta;
         }
       }
@@ -610,7 +568,7 @@ LOCAL uint64 ICACHE_FLASH_ATTR getNextActivityStart(SleeperStateT* sleeperState)
   {
     // found activity for today
     sleeperState->now = getTime();
-    return sleeperState->now + 60000UL*minutesTillStart; // milliseconds
+    return getLocalStartTime(sleeperState, 0, minuteOfDay + minutesTillStart); // milliseconds
   }
 
   // nothing found for today, check tomorrow because tomorrow may be only a few seconds away
@@ -618,20 +576,21 @@ LOCAL uint64 ICACHE_FLASH_ATTR getNextActivityStart(SleeperStateT* sleeperState)
   for (int i=0; i<MAX_ACTIVITIES; i++)
   {
     ActivityT* activity = &sleeperState->rtcMem.activities[i];
-    //ets_uart_printf("getNextActivityStart: B checking next day %u: day %u minute %u\r\n", nextWday, activity->day, activity->startTime);
+    //LOG_DEBUG("getNextActivityStart: B checking next day %u: day %u minute %u\r\n", nextWday, activity->day, activity->startTime);
     if (activity->day == DAY_INVALID)
     {
       // found 1st invalid activity, done
       break;
     }
-    else if (activity->day == DAY_EVERY || (activity->day == DAY_SECOND && tms.tm_yday%2 == 0) ||
-             (activity->day == DAY_THIRD && tms.tm_yday%3 == 0) || (activity->day - DAY_SUNDAY) == nextWday)
+    else if (activity->valve == valveIndex &&
+             (activity->day == DAY_EVERY || (activity->day == DAY_SECOND && tms.tm_yday%2 == 0) ||
+              (activity->day == DAY_THIRD && tms.tm_yday%3 == 0) || (activity->day - DAY_SUNDAY) == nextWday))
     {
       // found activity for tomorrow
       if (activity->startTime < minutesTillStart)
       {
         // found activity that starts earlier
-        //ets_uart_printf("getNextActivityStart: B checking next: OK\r\n");
+        //LOG_DEBUG("getNextActivityStart: B checking next: OK\r\n");
         minutesTillStart = activity->startTime;
       }
     }
@@ -640,7 +599,7 @@ LOCAL uint64 ICACHE_FLASH_ATTR getNextActivityStart(SleeperStateT* sleeperState)
   {
     // found activity for tomorrow
     sleeperState->now = getTime();
-    return sleeperState->now + 60000UL*(MINUTES_PER_DAY - minuteOfDay + minutesTillStart); // milliseconds
+    return getLocalStartTime(sleeperState, 1, minutesTillStart); // milliseconds
   }
 
   // found nothing
@@ -658,56 +617,56 @@ LOCAL uint64 ICACHE_FLASH_ATTR operateValve(SleeperStateT* sleeperState, uint8*
   uint64 nextEventTime = 0;
 
   // operate valve
-  if (!sleeperState->rtcMem.valveOpen)
+  if (!valve->open)
   {
     // only open valve if valve status is OK or if manual override
-    if (sleeperState->rtcMem.lastValveOperationStatus == VALVE_STATUS_OK || sleeperState->rtcMem.override)
+    if (valve->status == VALVE_STATUS_OK || (sleeperState->rtcMem.override && valveIndex == 0))
     {
       if (sleeperState->now < valveTiming.start)
       {
         // waiting for start time (never start early)
-        ets_uart_printf("operateValve: waiting for start time\r\n");
+        LOG_DEBUG("operateValve: waiting for start time\r\n");
         nextEventTime = valveTiming.start;
       }
       else if (sleeperState->now < (valveTiming.end + SCHEDULE_TIME_TOLERANCE))
       {
         // start time reached but not end time: open valve and calculate actual end time
-        ets_uart_printf("operateValve: start time reached\r\n");
+        LOG_DEBUG("operateValve: start time reached\r\n");
         valveOpen(sleeperState);
-        sleeperState->rtcMem.valveCloseTime = sleeperState->now + valveTiming.duration;
-        sleeperState->rtcMem.valveCloseTimeEstimated = !sleeperState->timeSynchronized;
-        nextEventTime = sleeperState->rtcMem.valveCloseTime;
+        valve->closeTime = sleeperState->now + valveTiming.duration;
+        valve->closeTimeEstimated = !sleeperState->timeSynchronized;
+        nextEventTime = valve->closeTime;
       }
       else
       {
         // too late: keep valve closed
-        ets_uart_printf("operateValve: too late\r\n");
+        LOG_DEBUG("operateValve: too late\r\n");
         *fallback = true;
       }
     }
   }
   else
   {
-    if (sleeperState->now < valveTiming.start && sleeperState->rtcMem.mode == MODE_MANUAL)
+    if (sleeperState->now < valveTiming.start && sleeperState->rtcMem.mode == MODE_MANUAL && valveIndex == 0)
     {
       // next start time not reached: abort manual, close valve
-      ets_uart_printf("operateValve: start time not reached\r\n");
+      LOG_DEBUG("operateValve: start time not reached\r\n");
       valveClose(sleeperState);
       nextEventTime = valveTiming.start;
     }
-    else if (sleeperState->now >= sleeperState->rtcMem.valveCloseTime)
+    else if (sleeperState->now >= valve->closeTime)
     {
       // end time reached: close valve (never stop early)
-      ets_uart_printf("operateValve: end time reached\r\n");
+      LOG_DEBUG("operateValve: end time reached\r\n");
       valveClose(sleeperState);
-      sleeperState->rtcMem.valveCloseTime = 0;
+      valve->closeTime = 0;
       *fallback = true;
     }
     else
     {
       // start time reached: open valve or keep valve open
-      ets_uart_printf("operateValve: keep open\r\n");
-      nextEventTime = sleeperState->rtcMem.valveCloseTime;
+      LOG_DEBUG("operateValve: keep open\r\n");
+      nextEventTime = valve->closeTime;
     }
   }
 
@@ -723,22 +682,22 @@ LOCAL uint64 ICACHE_FLASH_ATTR operateValve(SleeperStateT* sleeperState, uint8*
  *
  * @return next event time or 0 if no next event is pending
  */
-uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode, uint64 startTime, uint8 toggleOverride, uint8 ignoreOverride)
+LOCAL uint64 ICACHE_FLASH_ATTR controlValve(SleeperStateT* sleeperState, uint8 setMode, uint64 startTime, uint8 toggleOverride, uint8 ignoreOverride)
 {
   uint64 nextEventTime = 0;
 
   sleeperState->now = getTime();
-  esp_gmtime(&sleeperState->now, &tms);
+  esp_localtime(&sleeperState->now, &sleeperState->rtcMem.timeZone, &tms);
 
   if (sleeperState->rtcMem.lowBattery)
   {
     // priority 1: low battery
-    if (sleeperState->rtcMem.valveOpen)
+    if (valve->open)
     {
       // valve still open, close valve immediately
-      ets_uart_printf("valveControl: low battery shutdown\r\n");
+      LOG_DEBUG("valveControl: low battery shutdown\r\n");
       valveClose(sleeperState);
-      sleeperState->rtcMem.valveCloseTime = 0;
+      valve->closeTime = 0;
     }
   }
   else
@@ -747,7 +706,7 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
     if (toggleOverride)
     {
       // priority 2: manual override request
-      ets_uart_printf("valveControl: override request\r\n");
+      LOG_DEBUG("valveControl: override request\r\n");
       if (!sleeperState->rtcMem.override)
       {
         // override initiated, backup current mode
@@ -755,12 +714,12 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
       }
 
       // toggle valve state
-      if (sleeperState->rtcMem.valveOpen)
+      if (valve->open)
       {
         // close valve immediately
-        ets_uart_printf("valveControl: override close\r\n");
+        LOG_DEBUG("valveControl: override close\r\n");
         valveClose(sleeperState);
-        sleeperState->rtcMem.valveCloseTime = 0;
+        valve->closeTime = 0;
         sleeperState->rtcMem.overrideEndTime = getOverrideEndTime(sleeperState, sleeperState->rtcMem.overriddenMode, startTime);
         sleeperState->rtcMem.overrideEndTimeEstimated = !sleeperState->timeSynchronized;
         if (sleeperState->now <= sleeperState->rtcMem.overrideEndTime)
@@ -781,23 +740,23 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
       else
       {
         // open valve immediately using manual mode
-        ets_uart_printf("valveControl: schedule override open\r\n");
+        LOG_DEBUG("valveControl: schedule override open\r\n");
         sleeperState->rtcMem.override = true;
-        nextEventTime = valveControl(sleeperState, MODE_MANUAL, startTime, false, true);
+        nextEventTime = controlValve(sleeperState, MODE_MANUAL, startTime, false, true);
         sleeperState->rtcMem.overrideEndTime = 0; // must be set when closing valve
       }
     }
     else if (sleeperState->rtcMem.override && !ignoreOverride)
     {
-      ets_uart_printf("valveControl: override mode\r\n");
+      LOG_DEBUG("valveControl: override mode\r\n");
 
       // override operation in progress
-      if (sleeperState->rtcMem.valveOpen)
+      if (valve->open)
       {
         // maintain manual mode until valve is closed
-        nextEventTime = valveControl(sleeperState, MODE_MANUAL, 0, false, true);
+        nextEventTime = controlValve(sleeperState, MODE_MANUAL, 0, false, true);
       }
-      if (!sleeperState->rtcMem.valveOpen)
+      if (!valve->open)
       {
         // valve is closed, calculate end of override time
         if (sleeperState->rtcMem.overrideEndTime == 0)
@@ -814,12 +773,12 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
         else
         {
           // valve is closed and override has ended or requested mode is OFF, unlock
-          ets_uart_printf("valveControl: override end time reached\r\n");
+          LOG_DEBUG("valveControl: override end time reached\r\n");
           sleeperState->rtcMem.override = false;
 
           // activate set mode and immediately reexecute valve control
           sleeperState->rtcMem.mode = setMode;
-          nextEventTime = valveControl(sleeperState, sleeperState->rtcMem.mode, startTime, false, false);
+          nextEventTime = controlValve(sleeperState, sleeperState->rtcMem.mode, startTime, false, false);
         }
       }
     }
@@ -830,7 +789,7 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
       {
         case MODE_AUTO:
         {
-          ets_uart_printf("valveControl: auto mode\r\n");
+          LOG_DEBUG("valveControl: auto mode\r\n");
           if (calculateValveTiming(sleeperState, MODE_AUTO, 0, 0))
           {
             // operate valve
@@ -840,19 +799,19 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
           else
           {
             // no new activity found, finalize pending activity
-            if (sleeperState->rtcMem.valveOpen)
+            if (valve->open)
             {
-              if (sleeperState->now >= sleeperState->rtcMem.valveCloseTime)
+              if (sleeperState->now >= valve->closeTime)
               {
                 // end time reached: close valve
-                ets_uart_printf("valveControl: end time reached\r\n");
+                LOG_DEBUG("valveControl: end time reached\r\n");
                 valveClose(sleeperState);
-                sleeperState->rtcMem.valveCloseTime = 0;
+                valve->closeTime = 0;
               }
               else
               {
                 // start time reached: keep valve open
-                nextEventTime = sleeperState->rtcMem.valveCloseTime;
+                nextEventTime = valve->closeTime;
               }
             }
           }
@@ -865,7 +824,7 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
           // manual mode: abort auto program, wait for start and enable valve for duration
           if (!sleeperState->rtcMem.override)
           {
-            ets_uart_printf("valveControl: manual mode\r\n");
+            LOG_DEBUG("valveControl: manual mode\r\n");
           }
           uint8 fallback = false;
           calculateValveTiming(sleeperState, MODE_MANUAL, startTime, sleeperState->rtcMem.defaultDuration);
@@ -892,11 +851,11 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
         }
 
         case MODE_OFF:
-          ets_uart_printf("valveControl: off\r\n");
-          if (sleeperState->rtcMem.valveOpen)
+          LOG_DEBUG("valveControl: off\r\n");
+          if (valve->open)
           {
             valveClose(sleeperState);
-            sleeperState->rtcMem.valveCloseTime = 0;
+            valve->closeTime = 0;
           }
           sleeperState->rtcMem.mode = MODE_OFF;
           break;
@@ -910,11 +869,103 @@ uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode
     nextEventTime = getNextActivityStart(sleeperState);
   }
 
-  ets_uart_printf("valveControl: now %llu, next %llu\r\n", sleeperState->now, nextEventTime);
+  LOG_DEBUG("valveControl: now %llu, next %llu\r\n", sleeperState->now, nextEventTime);
 
   return nextEventTime;
 }
 
 
+#if MAX_VALVES > 1
+/**
+ * @return true if additional valves should follow their schedule
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR isAutoMode(SleeperStateT* sleeperState)
+{
+  // mode of valve 0 before manual operation or override
+  uint8 mode = sleeperState->rtcMem.override? sleeperState->rtcMem.overriddenMode : sleeperState->rtcMem.mode;
+  if (mode == MODE_MANUAL)
+  {
+    mode = sleeperState->rtcMem.offMode;
+  }
+  return mode == MODE_AUTO;
+}
 
+/**
+ * operate additional valve following its schedule in AUTO mode, otherwise keep valve closed
+ *
+ * @return next event time or 0 if no next event is pending
+ */
+LOCAL uint64 ICACHE_FLASH_ATTR controlZone(SleeperStateT* sleeperState, uint8 autoMode)
+{
+  uint64 nextEventTime = 0;
 
+  sleeperState->now = getTime();
+  esp_localtime(&sleeperState->now, &sleeperState->rtcMem.timeZone, &tms);
+
+  if (sleeperState->rtcMem.lowBattery || !autoMode)
+  {
+    // close valve immediately
+    if (valve->open)
+    {
+      valveClose(sleeperState);
+      valve->closeTime = 0;
+    }
+  }
+  else if (calculateValveTiming(sleeperState, MODE_AUTO, 0, 0))
+  {
+    // operate valve
+    uint8 fallback;
+    nextEventTime = operateValve(sleeperState, &fallback);
+  }
+  else if (valve->open)
+  {
+    // no new activity found, finalize pending activity
+    if (sleeperState->now >= valve->closeTime)
+    {
+      valveClose(sleeperState);
+      valve->closeTime = 0;
+    }
+    else
+    {
+      nextEventTime = valve->closeTime;
+    }
+  }
+
+  if (nextEventTime == 0 && autoMode && !sleeperState->rtcMem.lowBattery)
+  {
+    // nothing to do, try find next activity
+    nextEventTime = getNextActivityStart(sleeperState);
+  }
+
+  LOG_DEBUG("valveControl: valve %u, next %llu\r\n", valveIndex, nextEventTime);
+
+  return nextEventTime;
+}
+#endif
+
+/**
+ * operate all valves, valve 0 supports all modes and override, additional valves only follow their schedule in AUTO mode
+ *
+ * @return next event time of all valves or 0 if no next event is pending
+ */
+uint64 ICACHE_FLASH_ATTR valveControl(SleeperStateT* sleeperState, uint8 setMode, uint64 startTime, uint8 toggleOverride, uint8 ignoreOverride)
+{
+  setValve(sleeperState, 0);
+  uint64 nextEventTime = controlValve(sleeperState, setMode, startTime, toggleOverride, ignoreOverride);
+
+#if MAX_VALVES > 1
+  uint8 autoMode = isAutoMode(sleeperState);
+  for (uint8 i=1; i<MAX_VALVES; i++)
+  {
+    setValve(sleeperState, i);
+    uint64 eventTime = controlZone(sleeperState, autoMode);
+    if (eventTime > 0 && (nextEventTime == 0 || eventTime < nextEventTime))
+    {
+      nextEventTime = eventTime;
+    }
+  }
+  setValve(sleeperState, 0);
+#endif
+
+  return nextEventTime;
+}
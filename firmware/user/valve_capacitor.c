@@ -0,0 +1,512 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2015-2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    valve_capacitor.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * Capacitor valve driver (valve driver type 1), extracted from valve.c.
+ * A failed open pulse is reported by the valve status, closing the valve
+ * is left to the valve scheduler.
+ *
+ *****************************************************************************/
+
+#include "valve_driver.h"
+
+#include <eagle_soc.h>
+#include <gpio.h>
+#include <osapi.h>
+
+#include "adc.h"
+#include "fixmath.h"
+#include "trace.h"
+#include "valve_capacitor.h"
+
+/**
+ * called first at OS init
+ */
+LOCAL void ICACHE_FLASH_ATTR initDriver()
+{
+  // configure GPIO outputs
+  PIN_FUNC_SELECT(GENERATOR_GPIO_MUX,   GENERATOR_GPIO_FUNC);
+  PIN_FUNC_SELECT(OPEN_VALVE_GPIO_MUX,  OPEN_VALVE_GPIO_FUNC);
+  PIN_FUNC_SELECT(CLOSE_VALVE_GPIO_MUX, CLOSE_VALVE_GPIO_FUNC);
+  PIN_FUNC_SELECT(CAPACITOR_GPIO_MUX,   CAPACITOR_GPIO_FUNC);
+
+  // configure passive output state
+  GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
+  GPIO_DIS_OUTPUT(OPEN_VALVE_GPIO);
+  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 0);
+  GPIO_DIS_OUTPUT(CAPACITOR_GPIO);
+
+  // configure ADC GPIO
+  adcDriverInit();
+}
+
+enum ValvePhase {PHASE_IDLE        = 0,
+                 PHASE_DISCHARGE   = 1,  // discharge capacitor before opening
+                 PHASE_OPEN        = 2,  // charge capacitor via valve
+                 PHASE_RECHARGE    = 3,  // recharge capacitor bypassing valve before closing
+                 PHASE_CLOSE       = 4}; // discharge capacitor via valve
+
+typedef struct
+{
+  uint32 t0;                    // [us] start of phase
+  uint32 timeout;               // [us] max. duration of phase
+  uint32 slopeTime;             // [us]
+  uint32 minSlope;              // [mV/ms]
+  uint32 minSlopeTime;          // [us]
+  uint32 latchTime;             // [us]
+  uint16 initialVoltage;        // [mV] capacitor voltage at start of phase
+  uint16 voltage;               // [mV] last capacitor voltage
+  uint16 requiredVoltage;       // [mV]
+  uint16 supplyVoltage;         // [mV]
+  uint16 slopeVoltage;          // [mV]
+  uint16 resistance;            // [ohm]
+  uint8  detectSupplyVoltage;   // bool
+  uint8  chargeTimeout;         // bool
+  uint8  precharge;             // bool, recharge capacitor without closing valve
+} SequenceT;
+
+LOCAL SequenceT seq;
+LOCAL uint8 phase;
+LOCAL ValveStateT* valve;
+
+/**
+ * start charging capacitor via valve to open valve
+ */
+LOCAL void ICACHE_FLASH_ATTR startOpenPulse(SleeperStateT* sleeperState)
+{
+  // open latching valve by charing capacitor
+  seq.initialVoltage = adcRead(); // [mV]
+  seq.t0 = system_get_time(); // [us]
+  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO, 0);
+
+  // check voltage every few milliseconds
+  seq.supplyVoltage = sleeperState->rtcMem.valveSupplyVoltage > NOMINAL_SUPPLY_VOLTAGE && sleeperState->rtcMem.valveSupplyVoltage < MAX_VALID_SUPPLY_VOLTAGE? sleeperState->rtcMem.valveSupplyVoltage : TYPICAL_SUPPLY_VOLTAGE; // [mV]
+  seq.voltage = seq.initialVoltage;
+  seq.timeout = VALVE_OPEN_PULSE_DURATION; // max. 250 ms (Gardena valve timing)
+  seq.resistance = 0;
+  seq.slopeTime = 0;
+  seq.slopeVoltage = seq.initialVoltage;
+  seq.minSlope = 0xFFFFFFFF;
+  seq.minSlopeTime = 0;
+  seq.latchTime = 0;
+  traceStart(TRACE_OPEN, seq.timeout, seq.initialVoltage);
+  phase = PHASE_OPEN;
+}
+
+/**
+ * open valve
+ */
+LOCAL void ICACHE_FLASH_ATTR startOpen(SleeperStateT* sleeperState)
+{
+  // discharge capacitor as much as possible while powering up generator (this may also close valve if still open)
+  seq.initialVoltage = adcRead(); // [mV]
+  seq.t0 = system_get_time(); // [us]
+  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 1);
+
+  // start generator
+  GPIO_OUTPUT_SET(GENERATOR_GPIO, 1);
+
+  // monitor capacitor discharge, typically no discharging required
+  //
+  // notes:
+  // (1) discharging will fail if valve is not properly connected
+  // (2) full discharge not possible because MOSFET to 9V is not completely closed
+  //
+  seq.voltage = seq.initialVoltage;
+  seq.requiredVoltage = MAX_DISCHARGE_VOLTAGE_2; // [mV]
+  if (seq.initialVoltage > seq.requiredVoltage)
+  {
+    // estimate max. discharge time (valve + resistor)
+    seq.timeout = ((uint64)RC_CONSTANT*6/5*fixLnRatio(seq.initialVoltage, seq.requiredVoltage) + FIX_ONE/2)/FIX_ONE; // [us]
+    LOG_INFO("valve: discharge timeout %lu us\r\n", seq.timeout);
+    if (seq.timeout > MAX_DISCHARGE_TIMEOUT)
+    {
+      seq.timeout = MAX_DISCHARGE_TIMEOUT;
+    }
+
+    // check voltage every few milliseconds
+    traceStart(TRACE_DISCHARGE, seq.timeout, seq.initialVoltage);
+    phase = PHASE_DISCHARGE;
+  }
+  else
+  {
+    LOG_INFO("valve: no discharge needed at %u mV\r\n", seq.initialVoltage);
+
+    // stop discharging capacitor
+    GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 0);
+    startOpenPulse(sleeperState);
+  }
+}
+
+/**
+ * monitor capacitor discharge before opening valve
+ */
+LOCAL void ICACHE_FLASH_ATTR stepDischarge(SleeperStateT* sleeperState)
+{
+  seq.voltage = adcRead(); // [mV]
+  uint32 duration = system_get_time() - seq.t0; // [us]
+  bool discharged = seq.voltage <= seq.requiredVoltage;
+  bool dischargeTimeout = !discharged && (duration >= seq.timeout);
+  traceSample(duration, seq.voltage);
+  if (!discharged && !dischargeTimeout)
+  {
+    return;
+  }
+
+  uint32 tau = traceFinish(0); // [us]
+  if (!dischargeTimeout && tau)
+  {
+    // effective capacitance from known resistance of discharge path
+    uint32 capacitance = (uint64)tau*CAPACITANCE/RC_CONSTANT; // [uF]
+    if (capacitance >= CAPACITANCE/2 && capacitance <= 2*CAPACITANCE)
+    {
+      sleeperState->rtcMem.valveCapacitance = capacitance;
+    }
+    LOG_INFO("valve: discharge tau %lu us, capacitance %lu uF\r\n", tau, capacitance);
+  }
+  LOG_INFO("valve: discharged %u -> %u mV in %lu us\r\n", seq.initialVoltage, seq.voltage, duration);
+
+  // stop discharging capacitor
+  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 0);
+
+  if (!dischargeTimeout)
+  {
+    startOpenPulse(sleeperState);
+  }
+  else
+  {
+    // discharging failed, disable generator
+    GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
+    phase = PHASE_IDLE;
+
+    // revert valve state (valve is only opened if closed)
+    valve->open = false;
+    valve->openCount--;
+
+    LOG_INFO("valve: not opened (bad wiring)\r\n");
+    valve->status = VALVE_STATUS_BAD_WIRING;
+  }
+}
+
+/**
+ * monitor capacitor charge while opening valve
+ */
+LOCAL void ICACHE_FLASH_ATTR stepOpen(SleeperStateT* sleeperState)
+{
+  seq.voltage = adcRead();
+  uint32 duration = system_get_time() - seq.t0; // [us]
+  traceSample(duration, seq.voltage);
+  if (seq.voltage > seq.supplyVoltage && seq.voltage < MAX_VALID_SUPPLY_VOLTAGE)
+  {
+    // update supply voltage (find maximum)
+    seq.supplyVoltage = seq.voltage;
+    sleeperState->rtcMem.valveSupplyVoltage = seq.supplyVoltage;
+  }
+  if (!seq.resistance && seq.voltage >= NOMINAL_SUPPLY_VOLTAGE && seq.voltage < seq.supplyVoltage)
+  {
+    // resistance when charged to nominal supply voltage: R = -t/(C*ln(1 - U/U0))
+    uint32 rcLog = CAPACITANCE*fixLnRatio(seq.supplyVoltage, seq.supplyVoltage - seq.voltage); // [uF] Q16.16
+    seq.resistance = rcLog? (((uint64)duration << 16) + rcLog/2)/rcLog : 0; // [ohm]
+    LOG_INFO("valve: resistance %u ohm after %lu us\r\n", seq.resistance, duration);
+  }
+  if (!seq.latchTime && duration >= LATCH_DETECT_MIN_TIME && duration - seq.slopeTime >= LATCH_DETECT_INTERVAL)
+  {
+    // detect latching: the charge current (slope of capacitor voltage) decays monotonically
+    // until the back EMF of the moving plunger causes a temporary current dip
+    uint32 slope = seq.voltage > seq.slopeVoltage? 1000UL*(seq.voltage - seq.slopeVoltage)/(duration - seq.slopeTime) : 0; // [mV/ms]
+    if (slope < seq.minSlope)
+    {
+      seq.minSlope = slope;
+      seq.minSlopeTime = duration;
+    }
+    else if (seq.slopeTime && slope > seq.minSlope + LATCH_DETECT_TOLERANCE)
+    {
+      seq.latchTime = seq.minSlopeTime;
+      LOG_INFO("valve: latched after %lu us\r\n", seq.latchTime);
+
+      // terminate pulse after safety margin, but not before learned latch time
+      if (sleeperState->rtcMem.openPulseMargin)
+      {
+        uint32 learnedTime = 1000UL*sleeperState->rtcMem.openLatchTime; // [us]
+        uint32 pulseEnd = (seq.latchTime > learnedTime? seq.latchTime : learnedTime) + 1000UL*sleeperState->rtcMem.openPulseMargin; // [us]
+        if (pulseEnd < seq.timeout)
+        {
+          seq.timeout = pulseEnd;
+        }
+      }
+    }
+    seq.slopeTime = duration;
+    seq.slopeVoltage = seq.voltage;
+  }
+  if (!valvePhaseElapsed(seq.t0, seq.timeout))
+  {
+    return;
+  }
+  seq.voltage = adcRead();
+  duration = system_get_time() - seq.t0; // [us]
+  LOG_INFO("valve: charged %u -> %u mV @ %u mV in %lu us\r\n", seq.initialVoltage, seq.voltage, seq.supplyVoltage, duration);
+
+  // learn latch time of valve and report pulse time used
+  if (seq.latchTime)
+  {
+    uint8 latchMs = seq.latchTime/1000 < 0xFF? seq.latchTime/1000 : 0xFF; // [ms]
+    sleeperState->rtcMem.openLatchTime = sleeperState->rtcMem.openLatchTime? (3*sleeperState->rtcMem.openLatchTime + latchMs + 2)/4 : latchMs;
+  }
+  sleeperState->rtcMem.lastOpenPulseTime = duration/1000 < 0xFF? duration/1000 : 0xFF; // [ms]
+
+  // fit RC model to charge curve, more robust than single point resistance
+  uint32 tau = traceFinish(seq.supplyVoltage); // [us]
+  uint16 capacitance = sleeperState->rtcMem.valveCapacitance? sleeperState->rtcMem.valveCapacitance : CAPACITANCE; // [uF]
+  uint32 fittedResistance = (tau + capacitance/2)/capacitance; // [ohm]
+  if (fittedResistance > 0 && fittedResistance < 0xFFFF)
+  {
+    LOG_INFO("valve: resistance %lu ohm fitted, tau %lu us\r\n", fittedResistance, tau);
+    seq.resistance = fittedResistance;
+  }
+
+  // disable power to valve and disable generator
+  GPIO_DIS_OUTPUT(OPEN_VALVE_GPIO);
+  GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
+  phase = PHASE_IDLE;
+
+  // update state
+  valve->resistance = seq.resistance;
+
+  // check capacitor voltage and valve resistance
+  uint16 resistance = seq.resistance;
+  LOG_INFO("valve: open %u mV (ADC max %u us)\r\n", seq.voltage, adcGetMaxReadTime());
+  if (resistance > 0 && (resistance < MIN_RESISTANCE
+                     || (sleeperState->rtcMem.maxValveResistance >  0 && resistance > sleeperState->rtcMem.maxValveResistance)
+                     || (sleeperState->rtcMem.maxValveResistance <= 0 && resistance > MAX_RESISTANCE)))
+  {
+    LOG_INFO("valve: may be open (bad wiring), trying to close ...\r\n");
+    valve->status = VALVE_STATUS_BAD_WIRING;
+  }
+  else if (seq.voltage >= seq.supplyVoltage - CHARGING_VOLTAGE_TOLERANCE || (seq.latchTime && duration < VALVE_OPEN_PULSE_DURATION))
+  {
+    // capacitor fully charged or pulse terminated early after latching
+    LOG_INFO("valve: opened\r\n");
+    valve->status = VALVE_STATUS_OK;
+  }
+  else
+  {
+    LOG_INFO("valve: may be open (low battery or bad wiring), trying to close ...\r\n");
+    valve->status = VALVE_STATUS_LOW_OPEN_VOLTAGE;
+  }
+}
+
+/**
+ * update valve driver supply voltage from recharged capacitor
+ */
+LOCAL void ICACHE_FLASH_ATTR updateSupplyVoltage(SleeperStateT* sleeperState)
+{
+  // detect valve driver supply voltage
+  if (seq.detectSupplyVoltage)
+  {
+    if (seq.voltage > NOMINAL_SUPPLY_VOLTAGE && seq.voltage < MAX_VALID_SUPPLY_VOLTAGE)
+    {
+      // init supply voltage
+      sleeperState->rtcMem.valveSupplyVoltage = seq.voltage;
+      LOG_INFO("valve: supply voltage %u mV\r\n", seq.voltage);
+      seq.chargeTimeout = false;
+    }
+    else
+    {
+      LOG_INFO("valve: supply voltage out of valid range (%u mV)\r\n", seq.voltage);
+    }
+  }
+
+  // stop capacitor charging and disable generator
+  GPIO_DIS_OUTPUT(CAPACITOR_GPIO);
+  os_delay_us(20); // 20 us
+  GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
+}
+
+/**
+ * start discharging capacitor via valve to close valve
+ */
+LOCAL void ICACHE_FLASH_ATTR startClosePulse(SleeperStateT* sleeperState)
+{
+  // close latching valve by discharging capacitor
+  seq.initialVoltage = adcRead(); // [mV]
+  seq.t0 = system_get_time(); // [us]
+  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 1);
+  seq.timeout = VALVE_CLOSE_PULSE_DURATION; // 62.5 ms (Gardena valve timing)
+  traceStart(TRACE_CLOSE, seq.timeout, seq.initialVoltage);
+  phase = PHASE_CLOSE;
+}
+
+/**
+ * recharge capacitor and close valve or keep capacitor charged for closing valve later
+ */
+LOCAL void ICACHE_FLASH_ATTR startClose(SleeperStateT* sleeperState, uint8 precharge)
+{
+  seq.precharge = precharge;
+  seq.initialVoltage = adcRead(); // [mV]
+  seq.voltage = seq.initialVoltage;
+  seq.detectSupplyVoltage = sleeperState->rtcMem.valveSupplyVoltage < NOMINAL_SUPPLY_VOLTAGE || sleeperState->rtcMem.valveSupplyVoltage > MAX_VALID_SUPPLY_VOLTAGE;
+  seq.requiredVoltage = !seq.detectSupplyVoltage? NOMINAL_SUPPLY_VOLTAGE : MAX_VALID_SUPPLY_VOLTAGE; // [mV] - 9.25 V are typically reached after about 84 ms with R = 18 ohm
+  seq.timeout = !seq.detectSupplyVoltage? RECHARGE_TIMEOUT : 2*RECHARGE_TIMEOUT; // [us]
+  seq.chargeTimeout = false;
+  if (seq.initialVoltage < seq.requiredVoltage)
+  {
+    // start generator
+    GPIO_OUTPUT_SET(GENERATOR_GPIO, 1);
+    os_delay_us(1000); // 1 ms -> us
+
+    // recharge capacitor while bypassing valve, check voltage every few milliseconds
+    GPIO_OUTPUT_SET(CAPACITOR_GPIO, 0);
+    seq.t0 = system_get_time(); // [us]
+    phase = PHASE_RECHARGE;
+  }
+  else if (precharge)
+  {
+    LOG_INFO("valve: no pre-charging needed at %u mV\r\n", seq.initialVoltage);
+  }
+  else
+  {
+    // capacitor still charged, e.g. by pre-charging
+    LOG_INFO("valve: no charging needed at %u mV\r\n", seq.initialVoltage);
+    startClosePulse(sleeperState);
+  }
+}
+
+/**
+ * monitor capacitor recharge before closing valve
+ */
+LOCAL void ICACHE_FLASH_ATTR stepRecharge(SleeperStateT* sleeperState)
+{
+  seq.voltage = adcRead(); // [mV]
+  uint32 duration = system_get_time() - seq.t0; // [us]
+  bool charged = !seq.detectSupplyVoltage && seq.voltage > seq.requiredVoltage;
+  seq.chargeTimeout = !charged && (duration >= seq.timeout); // [us]
+  if (seq.chargeTimeout || charged)
+  {
+    LOG_INFO("valve: %scharged %u -> %u mV in %lu us\r\n", seq.precharge? "pre-" : "", seq.initialVoltage, seq.voltage, duration);
+    updateSupplyVoltage(sleeperState);
+    if (seq.precharge)
+    {
+      // capacitor keeps charge until valve is closed
+      phase = PHASE_IDLE;
+    }
+    else
+    {
+      startClosePulse(sleeperState);
+    }
+  }
+}
+
+/**
+ * monitor capacitor discharge while closing valve
+ */
+LOCAL void ICACHE_FLASH_ATTR stepClose(SleeperStateT* sleeperState)
+{
+  if (!valvePhaseElapsed(seq.t0, seq.timeout))
+  {
+    traceSample(system_get_time() - seq.t0, adcRead());
+    return;
+  }
+  uint32 tau = traceFinish(0); // [us]
+  LOG_INFO("valve: close tau %lu us\r\n", tau);
+  // keep CLOSE_VALVE_GPIO set to continue discharging capacitor until os shutdown
+  phase = PHASE_IDLE;
+
+  uint16 closeVoltage = adcRead();
+  LOG_INFO("valve: close %u mV\r\n", closeVoltage);
+  if (seq.chargeTimeout)
+  {
+    LOG_INFO("valve: probably not closed (low battery)\r\n");
+    valve->status = VALVE_STATUS_LOW_CLOSE_VOLTAGE;
+  }
+  else if (closeVoltage >= MAX_DISCHARGE_VOLTAGE_1) // [mV] - full discharge not possible in 62.5 ms (and not required for operating valve)
+  {
+    LOG_INFO("valve: probably not closed (bad wiring)\r\n");
+    valve->status = VALVE_STATUS_BAD_WIRING;
+  }
+  else
+  {
+    LOG_INFO("valve: closed\r\n");
+    // @todo only set OK status when opening?
+    valve->status = VALVE_STATUS_OK;
+  }
+}
+
+/**
+ * start opening valve
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR openValve(SleeperStateT* sleeperState, ValveStateT* operatedValve)
+{
+  valve = operatedValve;
+  startOpen(sleeperState);
+  return phase != PHASE_IDLE;
+}
+
+/**
+ * start closing valve
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR closeValve(SleeperStateT* sleeperState, ValveStateT* operatedValve)
+{
+  valve = operatedValve;
+  startClose(sleeperState, false);
+  return phase != PHASE_IDLE;
+}
+
+/**
+ * start pre-charging capacitor for closing valve
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR prepareValve(SleeperStateT* sleeperState, ValveStateT* operatedValve)
+{
+  valve = operatedValve;
+  startClose(sleeperState, true);
+  return phase != PHASE_IDLE;
+}
+
+/**
+ * continue valve operation in progress
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR stepValve(SleeperStateT* sleeperState)
+{
+  switch (phase)
+  {
+    case PHASE_DISCHARGE: stepDischarge(sleeperState); break;
+    case PHASE_OPEN:      stepOpen(sleeperState);      break;
+    case PHASE_RECHARGE:  stepRecharge(sleeperState);  break;
+    case PHASE_CLOSE:     stepClose(sleeperState);     break;
+  }
+  return phase != PHASE_IDLE;
+}
+
+/**
+ * called last before OS shutdown
+ */
+LOCAL void ICACHE_FLASH_ATTR shutdownDriver()
+{
+  // stop discharging capacitor (and possibly closing valve)
+  GPIO_OUTPUT_SET(CLOSE_VALVE_GPIO, 0);
+
+  // shutdown ADC GPIO
+  adcDriverShutdown();
+}
+
+const ValveDriverT capacitorDriver = {'C', initDriver, openValve, closeValve, prepareValve, stepValve, shutdownDriver};
@@ -0,0 +1,182 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2015-2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    valve_hbridge.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * H-bridge valve driver (valve driver type 2), extracted from valve.c.
+ * The pulse timing is taken from the server configurable pulse profile.
+ *
+ *****************************************************************************/
+
+#include "valve_driver.h"
+
+#include <eagle_soc.h>
+#include <gpio.h>
+#include <osapi.h>
+
+// GPIO  4 valve direction select (push/pull, active high, floating in deep sleep)
+// GPIO  5 operate valve          (push/pull, active high, floating in deep sleep)
+// GPIO 15 power supply enable    (push/pull, active high, pulldown)
+
+// close valve output
+#define OPEN_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO4_U
+#define OPEN_VALVE_GPIO_FUNC FUNC_GPIO4
+#define OPEN_VALVE_GPIO 4
+
+// open valve output works inverted!
+#define OPERATE_VALVE_GPIO_MUX PERIPHS_IO_MUX_GPIO5_U
+#define OPERATE_VALVE_GPIO_FUNC FUNC_GPIO5
+#define OPERATE_VALVE_GPIO 5
+
+// enable generator output
+#define GENERATOR_GPIO_MUX PERIPHS_IO_MUX_MTDO_U
+#define GENERATOR_GPIO_FUNC FUNC_GPIO15
+#define GENERATOR_GPIO 15
+
+/**
+ * called first at OS init
+ */
+LOCAL void ICACHE_FLASH_ATTR initDriver()
+{
+  // configure GPIO outputs and passive output state
+  PIN_FUNC_SELECT(GENERATOR_GPIO_MUX,     GENERATOR_GPIO_FUNC);
+  GPIO_OUTPUT_SET(GENERATOR_GPIO, 0);
+
+  PIN_FUNC_SELECT(OPERATE_VALVE_GPIO_MUX, OPERATE_VALVE_GPIO_FUNC);
+  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 0);
+
+  PIN_FUNC_SELECT(OPEN_VALVE_GPIO_MUX,    OPEN_VALVE_GPIO_FUNC);
+  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO, 0);
+}
+
+/**
+ * called last before OS shutdown
+ */
+LOCAL void ICACHE_FLASH_ATTR shutdownDriver()
+{
+  // passive GPIO output state
+  GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 0);
+  GPIO_OUTPUT_SET(GENERATOR_GPIO,     0);
+  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO,    0);
+}
+
+enum ValvePhase {PHASE_IDLE   = 0,
+                 PHASE_SETTLE = 1,  // wait for generator voltage to stabilize
+                 PHASE_PULSE  = 2,  // H-bridge enabled
+                 PHASE_SHORT  = 3}; // short circuit valve current
+
+LOCAL uint8  phase;
+LOCAL uint32 phaseStart;    // [us]
+LOCAL uint32 phaseDuration; // [us]
+LOCAL uint32 pulseDuration; // [us]
+LOCAL uint8  pulseOpen;     // bool, valve direction
+LOCAL ValveStateT* valve;
+
+/**
+ * estimate electrical energy of valve pulse
+ *
+ * @param duration [us]
+ * @return [mJ]
+ */
+LOCAL uint32 ICACHE_FLASH_ATTR getPulseEnergy(uint32 duration)
+{
+  // E = U*U/R*t
+  return (uint64)VALVE_DRIVE_VOLTAGE*VALVE_DRIVE_VOLTAGE/VALVE_NOMINAL_RESISTANCE*duration/1000000000UL;
+}
+
+/**
+ * enter next phase
+ */
+LOCAL void ICACHE_FLASH_ATTR startPhase(uint8 next, uint32 duration)
+{
+  phase = next;
+  phaseStart = system_get_time();
+  phaseDuration = duration;
+}
+
+/**
+ * continue valve operation in progress
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR stepValve(SleeperStateT* sleeperState)
+{
+  while (phase != PHASE_IDLE && valvePhaseElapsed(phaseStart, phaseDuration))
+  {
+    switch (phase)
+    {
+      case PHASE_SETTLE:
+        // operate valve by enabling H-bridge
+        GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 1);
+        startPhase(PHASE_PULSE, pulseDuration);
+        break;
+
+      case PHASE_PULSE:
+        // short circuit valve current
+        GPIO_OUTPUT_SET(OPERATE_VALVE_GPIO, 0);
+        startPhase(PHASE_SHORT, 100UL*sleeperState->rtcMem.pulseProfile.shortTime);
+        break;
+
+      default:
+        // done, go to passive state
+        shutdownDriver();
+        phase = PHASE_IDLE;
+        valve->status = VALVE_STATUS_OK;
+        LOG_INFO("valve: %s pulse %lu us, %lu mJ\r\n", pulseOpen? "open" : "close", pulseDuration, getPulseEnergy(pulseDuration));
+    }
+  }
+  return phase != PHASE_IDLE;
+}
+
+/**
+ * start valve pulse
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR startPulse(SleeperStateT* sleeperState, ValveStateT* operatedValve, uint8 open)
+{
+  const PulseProfileT* profile = &sleeperState->rtcMem.pulseProfile;
+  valve = operatedValve;
+  pulseOpen = open;
+  pulseDuration = 100UL*(pulseOpen? profile->openPulse : profile->closePulse); // [us]
+
+  // start generator, preset valve direction and wait for generator voltage to stabilize
+  GPIO_OUTPUT_SET(GENERATOR_GPIO,  1);
+  GPIO_OUTPUT_SET(OPEN_VALVE_GPIO, pulseOpen? 0 : 1);  // 0 -> VOUT1 = H, 1 -> VOUT2 = H
+  startPhase(PHASE_SETTLE, 100UL*profile->settleTime);
+  return stepValve(sleeperState);
+}
+
+/**
+ * start opening valve
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR openValve(SleeperStateT* sleeperState, ValveStateT* operatedValve)
+{
+  return startPulse(sleeperState, operatedValve, true);
+}
+
+/**
+ * start closing valve
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR closeValve(SleeperStateT* sleeperState, ValveStateT* operatedValve)
+{
+  return startPulse(sleeperState, operatedValve, false);
+}
+
+const ValveDriverT hbridgeDriver = {'H', initDriver, openValve, closeValve, NULL, stepValve, shutdownDriver};
@@ -0,0 +1,114 @@
+/*****************************************************************************
+ *
+ * Copyright (c) 2026 jnsbyr
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *****************************************************************************
+ *
+ * project: WLAN control unit for Gardena solenoid irrigation valve no. 1251
+ *
+ * file:    valve_sim.c
+ *
+ * created: 18.10.2026
+ *
+ *
+ * Simulated valve driver (valve driver type 3) for operating the firmware
+ * on a bare ESP8266 module. No GPIO is used. The pulse sequence follows
+ * the pulse profile with the same timer stepping as the real drivers, so
+ * scheduling, wake timing and awake time can be measured without valve
+ * hardware. The status of each open pulse is SIMULATED_OPEN_STATUS to
+ * exercise the error handling of the valve scheduler.
+ *
+ *****************************************************************************/
+
+#include "valve_driver.h"
+
+#include <osapi.h>
+
+LOCAL uint8  busy;          // bool
+LOCAL uint32 pulseStart;    // [us]
+LOCAL uint32 pulseDuration; // [us] including generator settle and short time
+LOCAL uint8  pulseOpen;     // bool, valve direction
+LOCAL ValveStateT* valve;
+LOCAL uint32 operationCount;
+
+/**
+ * called first at OS init
+ */
+LOCAL void ICACHE_FLASH_ATTR initDriver()
+{
+  LOG_INFO("valve: simulated driver\r\n");
+}
+
+/**
+ * called last before OS shutdown
+ */
+LOCAL void ICACHE_FLASH_ATTR shutdownDriver()
+{
+  LOG_INFO("valve: %lu simulated operations\r\n", operationCount);
+}
+
+/**
+ * continue valve operation in progress
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR stepValve(SleeperStateT* sleeperState)
+{
+  if (busy && valvePhaseElapsed(pulseStart, pulseDuration))
+  {
+    busy = false;
+    operationCount++;
+
+    // E = U*U/R*t of pulse without settle and short time
+    uint32 duration = 100UL*(pulseOpen? sleeperState->rtcMem.pulseProfile.openPulse : sleeperState->rtcMem.pulseProfile.closePulse); // [us]
+    uint32 energy = (uint64)VALVE_DRIVE_VOLTAGE*VALVE_DRIVE_VOLTAGE/VALVE_NOMINAL_RESISTANCE*duration/1000000000UL; // [mJ]
+    LOG_INFO("valve: simulated %s pulse %lu us, %lu mJ, late %lu us\r\n", pulseOpen? "open" : "close", duration, energy,
+             system_get_time() - pulseStart - pulseDuration);
+
+    valve->resistance = VALVE_NOMINAL_RESISTANCE;
+    valve->status = pulseOpen? SIMULATED_OPEN_STATUS : VALVE_STATUS_OK;
+  }
+  return busy;
+}
+
+/**
+ * start simulated valve pulse
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR startPulse(SleeperStateT* sleeperState, ValveStateT* operatedValve, uint8 open)
+{
+  const PulseProfileT* profile = &sleeperState->rtcMem.pulseProfile;
+  valve = operatedValve;
+  pulseOpen = open;
+  pulseDuration = 100UL*((pulseOpen? profile->openPulse : profile->closePulse) + profile->settleTime + profile->shortTime); // [us]
+  pulseStart = system_get_time();
+  busy = true;
+  return stepValve(sleeperState);
+}
+
+/**
+ * start opening valve
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR openValve(SleeperStateT* sleeperState, ValveStateT* operatedValve)
+{
+  return startPulse(sleeperState, operatedValve, true);
+}
+
+/**
+ * start closing valve
+ */
+LOCAL uint8 ICACHE_FLASH_ATTR closeValve(SleeperStateT* sleeperState, ValveStateT* operatedValve)
+{
+  return startPulse(sleeperState, operatedValve, false);
+}
+
+const ValveDriverT simulatedDriver = {'S', initDriver, openValve, closeValve, NULL, stepValve, shutdownDriver};